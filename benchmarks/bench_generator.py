@@ -0,0 +1,74 @@
+"""
+Measures how the generator's front end scales with the size of the header.
+
+Builds synthetic headers shaped like a preprocessed SDK header: for every struct, a few unrelated
+top-level declarations (as libc and other includes contribute), a chain of typedefs for its
+member types, and members referring to earlier structs. For each size it times preprocessing and
+parsing, then the struct analysis (process_struct over every struct, where typedef and struct
+lookups happen), and reports the time per struct: flat figures mean linear scaling. With
+--render, the whole generate_cbor_code run is timed too.
+"""
+
+import argparse
+import logging
+import sys
+import tempfile
+import time
+from pathlib import Path
+
+BENCH_DIR = Path(__file__).parent
+PROJECT_ROOT = BENCH_DIR.parent
+sys.path.insert(0, str(PROJECT_ROOT / "src"))
+
+from ailuropoda.cbor_codegen import (  # noqa: E402
+    find_structs_to_generate,
+    generate_cbor_code,
+    parse_c_string,
+    process_struct,
+)
+
+
+def synthetic_header(struct_count, filler_per_struct=3):
+    lines = ["#include <stdint.h>", "#include <stdbool.h>"]
+    for i in range(struct_count):
+        lines += [f"extern int filler_{i}_{j}(const char* text, int flags);" for j in range(filler_per_struct)]
+        lines += [f"typedef int32_t base_{i}_t;", f"typedef base_{i}_t value_{i}_t;"]
+        members = [f"value_{i}_t value;", "uint16_t flags[4];", "char label[16];", "double ratio;", "bool active;"]
+        if i:
+            members.append(f"Record{i - 1} previous;")
+        lines.append(f"typedef struct Record{i} {{ {' '.join(members)} }} Record{i};")
+    return "\n".join(lines) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark the generator on synthetic headers of growing size.")
+    parser.add_argument(
+        "sizes", nargs="*", type=int, default=[1250, 2500, 5000, 10000], help="Struct counts to measure."
+    )
+    parser.add_argument("--cpp-path", default="cpp", help="C preprocessor to use. Defaults to 'cpp'.")
+    parser.add_argument("--render", action="store_true", help="Also time a full generate_cbor_code run.")
+    args = parser.parse_args()
+    logging.disable(logging.WARNING)  # The generator logs every file it writes
+
+    print(f"{'structs':>8} {'parse s':>9} {'analyze s':>10} {'analyze us/struct':>18}" + (" {:>9}".format("full s") if args.render else ""))
+    for size in args.sizes:
+        header = synthetic_header(size)
+        start = time.perf_counter()
+        ast = parse_c_string(header, cpp_path=args.cpp_path)
+        parsed = time.perf_counter()
+        structs = [process_struct(node, ast) for node in find_structs_to_generate(ast)]
+        analyzed = time.perf_counter()
+        assert len(structs) == size
+        row = f"{size:>8} {parsed - start:>9.2f} {analyzed - parsed:>10.2f} {(analyzed - parsed) / size * 1e6:>18.1f}"
+        if args.render:
+            with tempfile.TemporaryDirectory(prefix="ailuropoda_bench_") as work_dir:
+                header_path = Path(work_dir) / "synthetic.h"
+                header_path.write_text(header)
+                start = time.perf_counter()
+                generate_cbor_code(header_path, Path(work_dir), cpp_path=args.cpp_path, use_cache=False)
+                row += f" {time.perf_counter() - start:>9.2f}"
+        print(row, flush=True)
+
+
+if __name__ == "__main__":
+    main()
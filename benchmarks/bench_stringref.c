@@ -0,0 +1,98 @@
+// Size and throughput of stringref deduplication (encode_X_stringref) on a Person[] directory.
+// Built and run by run_benchmarks.py; see the README "Benchmarks" section.
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cbor_generated.h"
+
+#define BUFFER_SIZE (256 * 1024)
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Unique names and e-mail addresses, with streets, cities and countries drawn from small pools
+static void fill_directory(struct Directory* directory, unsigned seed) {
+    static const char* const first_names[] = {"Ada", "Grace", "Alan", "Edsger", "Barbara", "Donald", "Frances", "Ken"};
+    static const char* const streets[] = {"Main St", "High St", "Station Rd", "Church Ln", "Park Ave", "Mill Rd"};
+    static const struct { const char* city; const char* country; } places[] = {
+        {"Springfield", "USA"}, {"Portland", "USA"}, {"Manchester", "UK"}, {"Bristol", "UK"},
+        {"Hamburg", "Germany"}, {"Lyon", "France"}, {"Toronto", "Canada"}, {"Melbourne", "Australia"},
+    };
+    srand(seed);
+    directory->count = DIRECTORY_SIZE;
+    for (size_t i = 0; i < DIRECTORY_SIZE; ++i) {
+        struct Person* person = &directory->people[i];
+        const char* first_name = first_names[rand() % 8];
+        size_t place = (size_t)(rand() % 8);
+        snprintf(person->name, sizeof(person->name), "%s %zu", first_name, i);
+        snprintf(person->email, sizeof(person->email), "%s.%zu@example.com", first_name, i);
+        person->age = 18 + (uint32_t)(rand() % 60);
+        snprintf(person->address.street, sizeof(person->address.street), "%d %s", 1 + rand() % 200,
+                 streets[rand() % 6]);
+        snprintf(person->address.city, sizeof(person->address.city), "%s", places[place].city);
+        snprintf(person->address.country, sizeof(person->address.country), "%s", places[place].country);
+        person->address.postal_code = 10000 + (uint32_t)(place * 1000) + (uint32_t)(rand() % 50);
+    }
+}
+
+typedef bool (*encode_fn)(const struct Directory*, CborEncoder*);
+typedef bool (*decode_fn)(struct Directory*, CborValue*);
+
+// Validates once, then decodes without per-value checks
+static bool decode_validated(struct Directory* data, CborValue* it) {
+    return validate_Directory(it, NULL) == CborNoError && decode_Directory_trusted(data, it);
+}
+
+static int bench(const char* label, encode_fn encode, decode_fn decode, const struct Directory* input, long iterations) {
+    static uint8_t buffer[BUFFER_SIZE];
+    static struct Directory output;
+    CborEncoder encoder;
+    double start = now_seconds();
+    for (long i = 0; i < iterations; ++i) {
+        cbor_encoder_init(&encoder, buffer, sizeof(buffer), 0);
+        if (!encode(input, &encoder)) {
+            fprintf(stderr, "%s: encode failed\n", label);
+            return 1;
+        }
+    }
+    double encode_seconds = now_seconds() - start;
+    size_t encoded_size = cbor_encoder_get_buffer_size(&encoder, buffer);
+    start = now_seconds();
+    for (long i = 0; i < iterations; ++i) {
+        CborParser parser;
+        CborValue it;
+        if (cbor_parser_init(buffer, encoded_size, 0, &parser, &it) != CborNoError || !decode(&output, &it)) {
+            fprintf(stderr, "%s: decode failed\n", label);
+            return 1;
+        }
+    }
+    double decode_seconds = now_seconds() - start;
+    if (memcmp(input, &output, sizeof(output)) != 0) {
+        fprintf(stderr, "%s: round trip mismatch\n", label);
+        return 1;
+    }
+    // Throughput is in MB/s of struct data, so that both modes are measured against the same work
+    double total_bytes = (double)sizeof(*input) * (double)iterations;
+    fprintf(stderr, "%-12s %10zu %10.1f %10.1f\n", label, encoded_size, total_bytes / encode_seconds / 1e6,
+            total_bytes / decode_seconds / 1e6);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    long iterations = argc > 1 ? strtol(argv[1], NULL, 10) : 1000;
+    static struct Directory directory;
+    fill_directory(&directory, 42);
+
+    fprintf(stderr, "%d people\n%-12s %10s %10s %10s\n", DIRECTORY_SIZE, "mode", "encoded B", "enc MB/s", "dec MB/s");
+    if (bench("plain", encode_Directory, decode_Directory, &directory, iterations) != 0) return 1;
+    if (bench("validated", encode_Directory, decode_validated, &directory, iterations) != 0) return 1;
+    if (bench("trusted", encode_Directory, decode_Directory_trusted, &directory, iterations) != 0) return 1;
+    if (bench("stringref", encode_Directory_stringref, decode_Directory_stringref, &directory, iterations) != 0) return 1;
+    return 0;
+}
@@ -0,0 +1,91 @@
+// Compression ratio and throughput of the `timeseries` member codec on synthetic series.
+// Built and run by run_benchmarks.py; see the README "Benchmarks" section.
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cbor_generated.h"
+
+#define BUFFER_SIZE (64 * 1024)
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// A 1 kHz sampler with occasional jitter, a slowly drifting sensor reading and an event counter
+static void fill_trace(struct Trace* trace, unsigned seed) {
+    uint64_t timestamp = 1700000000000000ULL;
+    double reading = 21.5;
+    int32_t counter = 0;
+    srand(seed);
+    for (size_t i = 0; i < TRACE_LENGTH; ++i) {
+        timestamp += 1000 + ((rand() % 16) == 0 ? (uint64_t)(rand() % 5) : 0);
+        if ((rand() % 4) == 0) reading += ((rand() % 3) - 1) * 0.125;
+        counter += rand() % 3;
+        trace->ts[i] = timestamp;
+        trace->v[i] = reading;
+        trace->counter[i] = counter;
+    }
+}
+
+#define DEFINE_BENCH(NAME, TYPE)                                                                     \
+    static int bench_##NAME(const struct TYPE* input, long iterations) {                             \
+        static uint8_t buffer[BUFFER_SIZE];                                                          \
+        static struct TYPE output;                                                                   \
+        CborEncoder encoder;                                                                         \
+        size_t encoded_size = 0;                                                                     \
+        double start = now_seconds();                                                                \
+        for (long i = 0; i < iterations; ++i) {                                                      \
+            cbor_encoder_init(&encoder, buffer, sizeof(buffer), 0);                                  \
+            if (!encode_##TYPE(input, &encoder)) {                                                   \
+                fprintf(stderr, #TYPE ": encode failed\n");                                          \
+                return 1;                                                                            \
+            }                                                                                        \
+        }                                                                                            \
+        double encode_seconds = now_seconds() - start;                                               \
+        encoded_size = cbor_encoder_get_buffer_size(&encoder, buffer);                               \
+        start = now_seconds();                                                                       \
+        for (long i = 0; i < iterations; ++i) {                                                      \
+            CborParser parser;                                                                       \
+            CborValue it;                                                                            \
+            if (cbor_parser_init(buffer, encoded_size, 0, &parser, &it) != CborNoError ||            \
+                !decode_##TYPE(&output, &it)) {                                                      \
+                fprintf(stderr, #TYPE ": decode failed\n");                                          \
+                return 1;                                                                            \
+            }                                                                                        \
+        }                                                                                            \
+        double decode_seconds = now_seconds() - start;                                               \
+        if (memcmp(input, &output, sizeof(output)) != 0) {                                           \
+            fprintf(stderr, #TYPE ": round trip mismatch\n");                                        \
+            return 1;                                                                                \
+        }                                                                                            \
+        double total_bytes = (double)sizeof(*input) * (double)iterations;                            \
+        fprintf(stderr, "%-12s %8zu %10zu %7.2fx %10.3f %10.3f\n", #TYPE, sizeof(*input), encoded_size, \
+                (double)sizeof(*input) / (double)encoded_size, total_bytes / encode_seconds / 1e9,      \
+                total_bytes / decode_seconds / 1e9);                                                 \
+        return 0;                                                                                    \
+    }
+
+DEFINE_BENCH(timeseries, Trace)
+DEFINE_BENCH(plain, PlainTrace)
+
+int main(int argc, char** argv) {
+    long iterations = argc > 1 ? strtol(argv[1], NULL, 10) : 20000;
+    static struct Trace trace;
+    static struct PlainTrace plain;
+
+    fill_trace(&trace, 42);
+    memcpy(plain.ts, trace.ts, sizeof(plain.ts));
+    memcpy(plain.v, trace.v, sizeof(plain.v));
+    memcpy(plain.counter, trace.counter, sizeof(plain.counter));
+
+    fprintf(stderr, "%-12s %8s %10s %8s %10s %10s\n", "struct", "raw B", "encoded B", "ratio", "enc GB/s",
+            "dec GB/s");
+    if (bench_timeseries(&trace, iterations) != 0) return 1;
+    if (bench_plain(&plain, iterations) != 0) return 1;
+    return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef PEOPLE_DATA_H
+#define PEOPLE_DATA_H
+
+#include <stdint.h>
+
+#define DIRECTORY_SIZE 500
+
+struct Address {
+    char street[32];
+    char city[24];
+    char country[16];
+    uint32_t postal_code;
+};
+
+struct Person {
+    char name[32];
+    uint32_t age;
+    char email[48];
+    struct Address address;
+};
+
+// A directory export: an array of nested structs whose cities, countries and keys repeat
+struct Directory {
+    uint32_t count;
+    struct Person people[DIRECTORY_SIZE];
+};
+
+#endif // PEOPLE_DATA_H
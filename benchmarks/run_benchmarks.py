@@ -0,0 +1,94 @@
+"""
+Builds and runs the generated-code benchmarks in this directory.
+
+Each benchmark pairs a header with a driver: CBOR code is generated for the header, compiled
+together with the driver against an installed TinyCBOR, and the resulting binary is run. By
+default TinyCBOR is taken from the persistent cache that the integration tests populate
+(`build/persistent_deps_install`).
+"""
+
+import argparse
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+BENCH_DIR = Path(__file__).parent
+PROJECT_ROOT = BENCH_DIR.parent
+sys.path.insert(0, str(PROJECT_ROOT / "src"))
+
+from ailuropoda.cbor_codegen import generate_cbor_code  # noqa: E402
+
+# name -> (header, driver, generate_cbor_code options)
+BENCHMARKS = {
+    "timeseries": ("timeseries_data.h", "bench_timeseries.c", {}),
+    "stringref": ("people_data.h", "bench_stringref.c", {"stringref": True, "trusted": True}),
+}
+
+
+def build_benchmark(name, build_dir, tinycbor_prefix, cc, cflags):
+    header, driver, options = BENCHMARKS[name]
+    build_dir = build_dir / name
+    generated_dir = build_dir / "generated"
+    generated_dir.mkdir(parents=True, exist_ok=True)
+    generate_cbor_code(BENCH_DIR / header, generated_dir, cpp_path="cpp", **options)
+
+    include_flags = [f"-I{tinycbor_prefix / 'include'}", f"-I{generated_dir}"]
+    generated_object = build_dir / "cbor_generated.o"
+    subprocess.run(
+        [cc, *cflags, *include_flags, "-c", str(generated_dir / "cbor_generated.c"), "-o", str(generated_object)],
+        check=True,
+    )
+    executable = build_dir / Path(driver).stem
+    subprocess.run(
+        [cc, *cflags, *include_flags, str(BENCH_DIR / driver), str(generated_object),
+         str(tinycbor_prefix / "lib" / "libtinycbor.a"), "-lm", "-o", str(executable)],
+        check=True,
+    )
+    return executable
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Build and run the Ailuropoda benchmarks.")
+    parser.add_argument(
+        "--tinycbor-prefix",
+        type=Path,
+        default=PROJECT_ROOT / "build" / "persistent_deps_install",
+        help="TinyCBOR install prefix (containing include/tinycbor and lib/libtinycbor.a).",
+    )
+    parser.add_argument("--cc", default="cc", help="C compiler to use. Defaults to 'cc'.")
+    parser.add_argument(
+        "benchmarks",
+        nargs="*",
+        help=f"Benchmarks to run ({', '.join(sorted(BENCHMARKS))}). Defaults to all of them.",
+    )
+    parser.add_argument(
+        "--iterations", type=int, help="Encode/decode iterations, overriding each benchmark's own default."
+    )
+    parser.add_argument(
+        "--cflags",
+        default="-O2 -std=c11 -Wall -Wextra",
+        help="Compiler flags for the benchmark build. Defaults to '-O2 -std=c11 -Wall -Wextra'.",
+    )
+    args = parser.parse_args()
+
+    if not (args.tinycbor_prefix / "lib" / "libtinycbor.a").is_file():
+        print(f"TinyCBOR not found under {args.tinycbor_prefix}; pass --tinycbor-prefix.", file=sys.stderr)
+        sys.exit(1)
+
+    unknown = sorted(set(args.benchmarks) - set(BENCHMARKS))
+    if unknown:
+        parser.error(f"unknown benchmark(s): {', '.join(unknown)}")
+
+    failed = False
+    with tempfile.TemporaryDirectory(prefix="ailuropoda_bench_") as build_dir:
+        for name in args.benchmarks or sorted(BENCHMARKS):
+            print(f"== {name} ==", file=sys.stderr, flush=True)
+            executable = build_benchmark(name, Path(build_dir), args.tinycbor_prefix, args.cc, args.cflags.split())
+            command = [str(executable)] + ([str(args.iterations)] if args.iterations else [])
+            failed |= subprocess.run(command).returncode != 0
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
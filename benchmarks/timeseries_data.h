@@ -0,0 +1,32 @@
+#ifndef TIMESERIES_DATA_H
+#define TIMESERIES_DATA_H
+
+#include <stdint.h>
+
+#define TRACE_LENGTH 256
+
+// Annotated trace: every array uses the time-series codec. The annotations are only shown to the
+// generator, so the benchmark builds with -Wall without unknown-pragma warnings.
+struct Trace {
+#ifdef AILUROPODA_GENERATOR
+    #pragma ailuropoda timeseries
+#endif
+    uint64_t ts[TRACE_LENGTH];
+#ifdef AILUROPODA_GENERATOR
+    #pragma ailuropoda timeseries
+#endif
+    double v[TRACE_LENGTH];
+#ifdef AILUROPODA_GENERATOR
+    #pragma ailuropoda timeseries
+#endif
+    int32_t counter[TRACE_LENGTH];
+};
+
+// Same layout without annotations, encoded as plain CBOR arrays for comparison
+struct PlainTrace {
+    uint64_t ts[TRACE_LENGTH];
+    double v[TRACE_LENGTH];
+    int32_t counter[TRACE_LENGTH];
+};
+
+#endif // TIMESERIES_DATA_H
@@ -0,0 +1,98 @@
+# cmake/Modules/Ailuropoda.cmake
+# Generates the CBOR code for C headers at build time.
+#
+#   ailuropoda_generate(<target>
+#     HEADERS <header>...            # Headers (or .i files) with the structs to generate code for
+#     [OUTPUT_DIR <dir>]             # Where to generate; defaults to ${CMAKE_CURRENT_BINARY_DIR}/<target>
+#     [HEADER_ONLY] [STRINGREF] [FIXED_LAYOUT] [ENUM_NAMES] # The generator options of the same names
+#     [TRUSTED] [STREAMING] [DELTA]
+#     [INCLUDE_DIRS <dir>...]        # Where the headers' includes are, for cpp and the library's users
+#     [CPP_ARGS <arg>...]            # More C preprocessor arguments, e.g. -D flags
+#     [COMMAND <command>...])        # How to run the generator; defaults to ${AILUROPODA_EXECUTABLE}
+#
+# defines <target>, a static library of the generated code (an INTERFACE library with HEADER_ONLY)
+# whose users get cbor_generated.h on their include path. Link TinyCBOR with find_package(tinycbor)
+# beforehand. The generator runs from the build, not at configure time, and writes a depfile of
+# every header the C preprocessor read, so it only reruns when one of those changes.
+
+find_program(AILUROPODA_EXECUTABLE ailuropoda DOC "Path to the ailuropoda code generator")
+
+function(ailuropoda_generate target)
+  cmake_parse_arguments(PARSE_ARGV 1 ARG
+    "HEADER_ONLY;STRINGREF;FIXED_LAYOUT;ENUM_NAMES;TRUSTED;STREAMING;DELTA" "OUTPUT_DIR" "HEADERS;INCLUDE_DIRS;CPP_ARGS;COMMAND")
+  if(NOT ARG_HEADERS)
+    message(FATAL_ERROR "ailuropoda_generate(${target}): no HEADERS given")
+  endif()
+  if(NOT ARG_COMMAND)
+    if(NOT AILUROPODA_EXECUTABLE)
+      message(FATAL_ERROR "ailuropoda_generate(${target}): ailuropoda not found; set AILUROPODA_EXECUTABLE or pass COMMAND")
+    endif()
+    set(ARG_COMMAND ${AILUROPODA_EXECUTABLE})
+  endif()
+  if(NOT ARG_OUTPUT_DIR)
+    set(ARG_OUTPUT_DIR ${CMAKE_CURRENT_BINARY_DIR}/${target})
+  endif()
+
+  set(headers)
+  foreach(header IN LISTS ARG_HEADERS)
+    get_filename_component(header ${header} ABSOLUTE)
+    list(APPEND headers ${header})
+  endforeach()
+  set(include_dirs)
+  foreach(dir IN LISTS ARG_INCLUDE_DIRS)
+    get_filename_component(dir ${dir} ABSOLUTE)
+    list(APPEND include_dirs ${dir})
+    list(APPEND ARG_CPP_ARGS -I${dir})
+  endforeach()
+
+  set(options)
+  set(outputs ${ARG_OUTPUT_DIR}/cbor_generated.h)
+  foreach(option HEADER_ONLY STRINGREF FIXED_LAYOUT ENUM_NAMES TRUSTED STREAMING DELTA)
+    if(ARG_${option})
+      string(TOLOWER ${option} flag)
+      string(REPLACE "_" "-" flag ${flag})
+      list(APPEND options --${flag})
+    endif()
+  endforeach()
+  if(NOT ARG_HEADER_ONLY)
+    list(APPEND outputs ${ARG_OUTPUT_DIR}/cbor_generated.c)
+  endif()
+  if(ARG_CPP_ARGS)
+    list(APPEND options --cpp-args ${ARG_CPP_ARGS}) # Must come last: it takes the rest of the command line
+  endif()
+
+  # The generator touches the stamp on every run, but only rewrites the files whose content changed,
+  # so the code is only recompiled when the generated code did change
+  set(stamp ${ARG_OUTPUT_DIR}/cbor_generated.stamp)
+  set(depfile ${ARG_OUTPUT_DIR}/cbor_generated.d)
+  set(depfile_args)
+  if(CMAKE_GENERATOR MATCHES "Ninja" OR NOT CMAKE_VERSION VERSION_LESS 3.20)
+    set(depfile_args DEPFILE ${depfile})
+  else()
+    message(WARNING "ailuropoda_generate(${target}): ${CMAKE_GENERATOR} needs CMake 3.20 for depfiles; "
+      "the code is only regenerated when one of the HEADERS changes, not when a header they include does")
+  endif()
+  add_custom_command(
+    OUTPUT ${stamp}
+    BYPRODUCTS ${outputs}
+    COMMAND ${CMAKE_COMMAND} -E make_directory ${ARG_OUTPUT_DIR}
+    COMMAND ${ARG_COMMAND} ${headers} --output-dir ${ARG_OUTPUT_DIR} --depfile ${depfile} ${options}
+    DEPENDS ${headers}
+    ${depfile_args}
+    COMMENT "Generating CBOR code for ${target}"
+    VERBATIM)
+  add_custom_target(${target}_generate DEPENDS ${stamp})
+
+  if(ARG_HEADER_ONLY)
+    add_library(${target} INTERFACE)
+    target_link_libraries(${target} INTERFACE ${tinycbor_LIBRARIES})
+    target_include_directories(${target} INTERFACE ${ARG_OUTPUT_DIR} ${include_dirs} ${tinycbor_INCLUDE_DIRS})
+  else()
+    add_library(${target} STATIC ${ARG_OUTPUT_DIR}/cbor_generated.c)
+    target_link_libraries(${target} PRIVATE ${tinycbor_LIBRARIES})
+    target_include_directories(${target} PUBLIC ${ARG_OUTPUT_DIR} ${include_dirs} ${tinycbor_INCLUDE_DIRS})
+    set_target_properties(${target} PROPERTIES POSITION_INDEPENDENT_CODE ON)
+  endif()
+  # Followed through INTERFACE libraries since CMake 3.19, so users of a HEADER_ONLY target wait for it too
+  add_dependencies(${target} ${target}_generate)
+endfunction()
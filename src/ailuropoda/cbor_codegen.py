@@ -1,11 +1,24 @@
 import argparse
+import concurrent.futures
+import ctypes
+import functools
+import hashlib
+import json
+import math
+import os
+import re
+import selectors
+import socket
 import sys
 import logging
+import time
 from pathlib import Path
-import tempfile
+from struct import unpack_from
+import subprocess
+import weakref
 import shutil  # Import shutil for file operations
 
-from pycparser import CParser, c_ast, parse_file
+from pycparser import CParser, c_ast
 from jinja2 import Environment, FileSystemLoader
 
 # Configure logging
@@ -18,28 +31,71 @@ logger = logging.getLogger(__name__)
 # --- AST Traversal and Helper Functions ---
 
 
-def find_struct(struct_name, ast):
-    """Finds a struct definition by its name in the AST."""
-    for ext in ast.ext:
-        if isinstance(ext, c_ast.Decl) and isinstance(ext.type, c_ast.Struct):
-            if ext.type.name == struct_name:
-                return ext.type
-        elif (
-            isinstance(ext, c_ast.Typedef)
-            and isinstance(ext.type, c_ast.TypeDecl)
-            and isinstance(ext.type.type, c_ast.Struct)
-        ):
-            if ext.type.type.name == struct_name:
-                return ext.type.type
-    return None
+class SymbolIndex:
+    """
+    The definitions of a translation unit's top-level names, indexed in one pass over `ast.ext` so
+    that lookups don't rescan it: preprocessed headers that pull in libc and SDK headers have tens
+    of thousands of top-level declarations, and every member of every struct looks a type up.
+    Where a name is defined more than once, the first definition wins, as in a linear scan.
+    """
+
+    def __init__(self, ast):
+        self.structs = {}  # (c_ast.Struct or c_ast.Union, tag) -> node with members
+        self.typedefs = {}  # name -> c_ast.Typedef
+        self.enums = {}  # tag -> c_ast.Enum with enumerators
+        self._resolved = {}  # typedef name -> innermost type node, see resolve_typedef
+        for ext in ast.ext:
+            if isinstance(ext, c_ast.Typedef):
+                self.typedefs.setdefault(ext.name, ext)
+            node = ext.type if isinstance(ext, (c_ast.Decl, c_ast.Typedef)) else None
+            node = node.type if isinstance(node, c_ast.TypeDecl) else node
+            if isinstance(node, (c_ast.Struct, c_ast.Union)) and node.decls is not None:
+                self.structs.setdefault((type(node), node.name), node)
+            elif isinstance(node, c_ast.Enum) and node.values is not None:
+                self.enums.setdefault(node.name, node)
+
+    def resolve_typedef(self, typedef_name):
+        """
+        Returns the innermost type node a typedef name stands for, following chains of typedefs
+        (`typedef sample_t reading_t;`) down to a struct, union, enum or builtin type, or None if
+        the name isn't a typedef. Names the type map knows, such as `__int16_t`, end the chain.
+        """
+        if typedef_name not in self._resolved:
+            typedef_node = self.typedefs.get(typedef_name)
+            resolved = _get_base_type_from_decl(typedef_node.type) if typedef_node else None
+            if isinstance(resolved, c_ast.IdentifierType):
+                name = " ".join(resolved.names)
+                if name not in PREPROCESSED_TYPE_MAP and name != typedef_name:
+                    self._resolved[typedef_name] = resolved  # Ends any (invalid) cycle
+                    resolved = self.resolve_typedef(name) or resolved
+            self._resolved[typedef_name] = resolved
+        return self._resolved[typedef_name]
+
+
+_symbol_indexes = weakref.WeakKeyDictionary()  # FileAST -> SymbolIndex
+
+
+def symbol_index(ast):
+    """Returns the SymbolIndex of `ast`, building it on first use."""
+    index = _symbol_indexes.get(ast)
+    if index is None:
+        index = _symbol_indexes[ast] = SymbolIndex(ast)
+    return index
+
+
+def find_struct(struct_name, ast, kind=c_ast.Struct):
+    """Finds a struct (or, with `kind=c_ast.Union`, union) definition by its name in the AST."""
+    return symbol_index(ast).structs.get((kind, struct_name))
 
 
 def find_typedef(typedef_name, ast):
     """Finds a typedef definition by its name in the AST."""
-    for ext in ast.ext:
-        if isinstance(ext, c_ast.Typedef) and ext.name == typedef_name:
-            return ext
-    return None
+    return symbol_index(ast).typedefs.get(typedef_name)
+
+
+def find_enum(enum_name, ast):
+    """Finds the enumerator list of an enum definition by its name in the AST."""
+    return symbol_index(ast).enums.get(enum_name)
 
 
 def _get_base_type_from_decl(decl_node):
@@ -61,13 +117,11 @@ def expand_in_place(node, ast):
     if isinstance(node, c_ast.TypeDecl):
         if isinstance(node.type, c_ast.IdentifierType):
             typedef_name = node.type.names[0]
-            typedef_node = find_typedef(typedef_name, ast)
-            if typedef_node:
-                # Get the fully resolved base type from the typedef's definition
-                # This handles cases like `typedef int MyInt;` where typedef_node.type is TypeDecl
-                # and `typedef struct S MyS;` where typedef_node.type is TypeDecl
-                resolved_base_type = _get_base_type_from_decl(typedef_node.type)
-                node.type = resolved_base_type  # Replace the IdentifierType with the base type
+            resolved_base_type = symbol_index(ast).resolve_typedef(typedef_name)
+            if resolved_base_type is not None:
+                # Replace the IdentifierType with the type the typedef (chain) stands for, e.g. the
+                # IdentifierType of `typedef int MyInt;` or the Struct of `typedef struct S MyS;`
+                node.type = resolved_base_type
             # If node.type is not an IdentifierType (e.g., it's already a Struct, PtrDecl, ArrayDecl),
             # or if it was an IdentifierType but not a typedef, no further action needed here.
             # The recursive calls below will handle nested structures.
@@ -80,16 +134,114 @@ def expand_in_place(node, ast):
     elif isinstance(node, c_ast.Struct):
         if node.decls:
             for i, decl in enumerate(node.decls):
+                if isinstance(decl, c_ast.Pragma):
+                    continue  # Annotations carry no type information
                 node.decls[i].type = expand_in_place(decl.type, ast)
     # For IdentifierType or Struct nodes directly, no expansion needed, just return
     return node
 
 
-def get_type_info(node, ast):
+# Mapping for common preprocessed types to their standard C equivalents
+# This helps normalize names like '__uint32_t' to 'unsigned int' or 'uint32_t'
+PREPROCESSED_TYPE_MAP = {
+    "__uint8_t": "unsigned char",
+    "__uint16_t": "unsigned short",
+    "__uint32_t": "unsigned int",  # Map to 'unsigned int' to match test expectation
+    "__uint64_t": "unsigned long long",
+    "__int8_t": "signed char",
+    "__int16_t": "short",
+    "__int32_t": "int",
+    "__int64_t": "long long",
+    "signed char": "char",
+    "long int": "long",
+    "long long int": "long long",
+    "unsigned long int": "unsigned long",
+    "unsigned long long int": "unsigned long long",
+    "unsigned": "unsigned int",
+    "signed": "int",
+    "signed int": "int",
+    "short int": "short",
+    "unsigned short int": "unsigned short",
+}
+
+FLOAT_TYPES = ("float", "float_t", "double", "double_t")
+BOOL_TYPES = ("bool", "_Bool")
+SIGNED_INTEGER_TYPES = ("int", "long", "short", "char", "signed char", "int8_t", "int16_t", "int32_t", "int64_t", "long long")
+UNSIGNED_INTEGER_TYPES = (
+    "unsigned int",
+    "unsigned long",
+    "unsigned short",
+    "unsigned char",
+    "uint8_t",
+    "uint16_t",
+    "uint32_t",
+    "uint64_t",
+    "unsigned long long",
+)
+INTEGER_TYPES = SIGNED_INTEGER_TYPES + UNSIGNED_INTEGER_TYPES
+# <limits.h>/<stdint.h> bounds each integer type is range-checked against on decode
+INTEGER_LIMITS = {
+    "int": ("INT_MIN", "INT_MAX"),
+    "long": ("LONG_MIN", "LONG_MAX"),
+    "short": ("SHRT_MIN", "SHRT_MAX"),
+    "char": ("CHAR_MIN", "CHAR_MAX"),
+    "signed char": ("SCHAR_MIN", "SCHAR_MAX"),
+    "int8_t": ("INT8_MIN", "INT8_MAX"),
+    "int16_t": ("INT16_MIN", "INT16_MAX"),
+    "int32_t": ("INT32_MIN", "INT32_MAX"),
+    "int64_t": ("INT64_MIN", "INT64_MAX"),
+    "long long": ("LLONG_MIN", "LLONG_MAX"),
+    "unsigned int": ("0", "UINT_MAX"),
+    "unsigned long": ("0", "ULONG_MAX"),
+    "unsigned short": ("0", "USHRT_MAX"),
+    "unsigned char": ("0", "UCHAR_MAX"),
+    "uint8_t": ("0", "UINT8_MAX"),
+    "uint16_t": ("0", "UINT16_MAX"),
+    "uint32_t": ("0", "UINT32_MAX"),
+    "uint64_t": ("0", "UINT64_MAX"),
+    "unsigned long long": ("0", "ULLONG_MAX"),
+}
+SEEN_MASK_BITS = 64  # Members tracked by a decoder's `uint64_t` seen mask
+TIMESERIES_MAX_PAYLOAD = 4096  # Largest encode buffer (on the stack) of a time-series compressed array
+# Element sizes assumed when checking a time-series array against TIMESERIES_MAX_PAYLOAD; the
+# generated code sizes its buffer with sizeof. Types that aren't listed are assumed to be 8 bytes.
+ELEMENT_SIZES = {
+    "char": 1,
+    "signed char": 1,
+    "unsigned char": 1,
+    "int8_t": 1,
+    "uint8_t": 1,
+    "short": 2,
+    "unsigned short": 2,
+    "int16_t": 2,
+    "uint16_t": 2,
+    "int": 4,
+    "unsigned int": 4,
+    "int32_t": 4,
+    "uint32_t": 4,
+    "float": 4,
+}
+
+
+def array_dims(node):
+    """Returns the dimensions of an array declarator, outermost first (`float m[2][3]` gives [2, 3])."""
+    dims = []
+    while isinstance(node, c_ast.ArrayDecl) and node.dim is not None:
+        try:
+            dims.append(int(node.dim.value))
+        except (ValueError, TypeError, AttributeError):
+            break
+        node = node.type
+    return dims
+
+
+def get_type_info(node, ast, bitsize=None):
     """
     Extracts type information from a C AST node.
     Assumes typedefs have already been expanded by `expand_in_place`.
+    `bitsize` is the declaration's bitfield width node (`Decl.bitsize`), if any.
     Returns a tuple: (base_type_name, type_category, array_size, is_pointer)
+    Multi-dimensional arrays are "multidim_array"s whose array_size is their total element count.
     """
     is_pointer = False
     array_size = None
@@ -117,24 +269,6 @@ def get_type_info(node, ast):
     base_type_name = "unknown"
     type_category = "unknown"
 
-    # Mapping for common preprocessed types to their standard C equivalents
-    # This helps normalize names like '__uint32_t' to 'unsigned int' or 'uint32_t'
-    PREPROCESSED_TYPE_MAP = {
-        "__uint8_t": "unsigned char",
-        "__uint16_t": "unsigned short",
-        "__uint32_t": "unsigned int",  # Map to 'unsigned int' to match test expectation
-        "__uint64_t": "unsigned long long",
-        "__int8_t": "signed char",
-        "__int16_t": "short",
-        "__int32_t": "int",
-        "__int64_t": "long long",
-        "signed char": "char",
-        "long int": "long",
-        "long long int": "long long",
-        "unsigned long int": "unsigned long",
-        "unsigned long long int": "unsigned long long",
-    }
-
     if isinstance(current_node, c_ast.TypeDecl):
         # The actual type is inside current_node.type
         if isinstance(current_node.type, c_ast.IdentifierType):
@@ -142,6 +276,13 @@ def get_type_info(node, ast):
             base_type_name = PREPROCESSED_TYPE_MAP.get(raw_name, raw_name)
         elif isinstance(current_node.type, c_ast.Struct):
             base_type_name = current_node.type.name
+        elif isinstance(current_node.type, c_ast.Union):
+            base_type_name = current_node.type.name or "union"
+            type_category = "union"
+        elif isinstance(current_node.type, c_ast.Enum):
+            # Spelled as a C type; process_struct renames anonymous enums after their typedef
+            base_type_name = f"enum {current_node.type.name}" if current_node.type.name else "enum"
+            type_category = "primitive"
         else:
             logger.warning(f"Unexpected type inside TypeDecl: {type(current_node.type)}")
     elif isinstance(current_node, c_ast.Struct):
@@ -182,6 +323,7 @@ def get_type_info(node, ast):
         "unsigned long",
         "unsigned long long",
         "signed char",
+        "long long",
     ]:  # Include signed char as a primitive
         type_category = "primitive"
     elif type_category == "unknown" and base_type_name != "unknown":  # If it's a struct or something else
@@ -193,7 +335,13 @@ def get_type_info(node, ast):
             type_category = "unknown_primitive"  # Fallback for other primitive-like typedefs
 
     # Adjust category for arrays and pointers if they were the outermost type
-    if array_size is not None:
+    dims = array_dims(node)
+    if type_category == "union":
+        pass  # Arrays of and pointers to unions are rejected by process_struct
+    elif len(dims) > 1:
+        array_size = math.prod(dims)  # Flattened in row-major order, as C lays them out
+        type_category = "multidim_array"
+    elif array_size is not None:
         if type_category == "primitive" or type_category == "unknown_primitive":
             type_category = "array"
         elif type_category == "struct":
@@ -202,48 +350,746 @@ def get_type_info(node, ast):
         if type_category == "struct":
             type_category = "struct_ptr"
         # char_ptr is already handled
+    elif bitsize is not None and type_category == "primitive" and base_type_name in INTEGER_TYPES + BOOL_TYPES:
+        # Bitfields have no address, so they are read into and written from temporaries
+        type_category = "bitfield"
 
     return base_type_name, type_category, array_size, is_pointer
 
 
-def parse_c_string(c_code_string, cpp_path=None, cpp_args=None):
+# --- Member Annotations ---
+
+# Annotations are written as `#pragma ailuropoda <name>(<args>)` on the line(s) preceding
+# a struct member. Unlike comments they survive the C preprocessor, and pycparser keeps them
+# in the struct's declaration list as `c_ast.Pragma` nodes, in source order.
+ANNOTATION_PRAGMA = "ailuropoda"
+_ANNOTATION_RE = re.compile(r"^\s*(?P<name>[A-Za-z_]\w*)\s*(?:\((?P<args>.*)\))?\s*$")
+
+
+def _parse_annotation_value(text):
+    """Converts an annotation argument to int or float where possible, else keeps the string."""
+    text = text.strip()
+    for convert in (int, float):
+        try:
+            value = convert(text)
+        except ValueError:
+            continue
+        if not math.isfinite(value):  # The value ends up in C source, which has no inf/nan literals
+            raise ValueError(f"Annotation argument must be a finite number, got '{text}'")
+        return value
+    return text.strip("\"'")
+
+
+def parse_annotation(pragma_string):
     """
-    Parses a C code string into a pycparser AST, using a C preprocessor.
+    Parses the text of a `#pragma` into an annotation.
+    Returns a tuple (name, args) where args maps keyword arguments to their values
+    (positional arguments are stored under their index), or None if the pragma
+    is not an ailuropoda annotation.
+    """
+    parts = pragma_string.strip().split(None, 1)
+    if not parts or parts[0] != ANNOTATION_PRAGMA:
+        return None
+    if len(parts) == 1:
+        raise ValueError(f"Empty annotation: '#pragma {pragma_string}'")
+
+    match = _ANNOTATION_RE.match(parts[1])
+    if not match:
+        raise ValueError(f"Malformed annotation: '#pragma {pragma_string}'")
+
+    args = {}
+    if match.group("args"):
+        for index, arg in enumerate(match.group("args").split(",")):
+            if "=" in arg:
+                key, value = arg.split("=", 1)
+                args[key.strip()] = _parse_annotation_value(value)
+            elif arg.strip():
+                args[index] = _parse_annotation_value(arg)
+    return match.group("name"), args
+
+
+def _quantize_info(args, member_name):
+    """Validates `quantize(scale=..., offset=...)` arguments and returns the template parameters."""
+    scale = float(args.get("scale", args.get(0, 1.0)))
+    offset = float(args.get("offset", args.get(1, 0.0)))
+    if scale <= 0.0 or not math.isfinite(1.0 / scale):
+        raise ValueError(f"quantize scale for member '{member_name}' must be positive and normal, got {scale}")
+    return {"scale": repr(scale), "offset": repr(offset), "inv_scale": repr(1.0 / scale)}
+
+
+def _timeseries_max_payload(codec, type_name, count):
+    """The largest payload of `count` elements; TS_MAX_PAYLOAD_DOD/_XOR in the generated code."""
+    bits = ELEMENT_SIZES.get(type_name, 8) * 8
+    if codec == "dod":
+        return 10 + count * ((bits + 8) // 7)
+    return 10 + (count * (bits + 13) + 7) // 8
+
+
+def _timeseries_codec(member_info, struct_name):
+    """
+    Picks the time-series codec for an annotated array: delta-of-delta varints for integer
+    elements, Gorilla-style XOR bit packing for float elements. Returns None if neither applies,
+    or if the array's encode buffer would take more than TIMESERIES_MAX_PAYLOAD bytes of stack.
     """
-    # pycparser's parse_file is the easiest way to leverage cpp.
-    # We write the string to a temporary file and then parse it.
-    with tempfile.NamedTemporaryFile(mode="w+", suffix=".h", delete=False) as tmp_file:
-        tmp_file.write(c_code_string)
-        tmp_file_path = tmp_file.name
+    codec = None
+    if member_info["type_category"] == "array" and not member_info["quantize"]:
+        if member_info["type_name"] in INTEGER_TYPES:
+            codec = "dod"
+        elif member_info["type_name"] in FLOAT_TYPES:
+            codec = "xor"
+    if codec is None:
+        logger.warning(
+            f"Ignoring timeseries annotation on '{struct_name}.{member_info['name']}': "
+            f"only fixed-size, unquantized integer or float arrays can be compressed."
+        )
+        return None
+    max_payload = _timeseries_max_payload(codec, member_info["type_name"], member_info["array_size"])
+    if max_payload > TIMESERIES_MAX_PAYLOAD:
+        logger.warning(
+            f"Ignoring timeseries annotation on '{struct_name}.{member_info['name']}': "
+            f"its compressed form can take up to {max_payload} bytes, more than the "
+            f"{TIMESERIES_MAX_PAYLOAD}-byte encode buffer."
+        )
+        return None
+    return codec
+
 
+def _default_literal(member_info, value, struct_name):
+    """
+    Converts the argument of a `default(<value>)` annotation to the C literal that the decoder
+    writes when the member is absent. Returns None (with a warning) if the member can't take it.
+    """
+    type_name, category = member_info["type_name"], member_info["type_category"]
     try:
-        # Ensure cpp_args is a list
-        if cpp_args is None:
-            cpp_args_list = []
-        elif isinstance(cpp_args, str):
-            cpp_args_list = [cpp_args]
+        if category == "primitive" and member_info["enum"]:
+            names = dict(member_info["enum"]["values"])
+            if value in names or value in member_info["enum"]["distinct"]:
+                return str(value)
+        elif category in ("primitive", "bitfield") and type_name in BOOL_TYPES:
+            if str(value).lower() in ("1", "true"):
+                return "true"
+            if str(value).lower() in ("0", "false"):
+                return "false"
+        elif category in ("primitive", "bitfield") and type_name in FLOAT_TYPES:
+            return repr(float(value))
+        elif category in ("primitive", "bitfield") and type_name in INTEGER_TYPES:
+            literal = int(value)
+            if literal != value:
+                raise ValueError(value)
+            return str(literal) if type_name in SIGNED_INTEGER_TYPES else f"{literal}u"
+        elif category == "char_array" and isinstance(value, str) and len(value.encode()) < member_info["array_size"]:
+            return '"' + value.replace("\\", "\\\\").replace('"', '\\"') + '"'
+    except (TypeError, ValueError):
+        pass
+    logger.warning(
+        f"Ignoring default annotation on '{struct_name}.{member_info['name']}': "
+        f"{value!r} is not a valid default for a {type_name} {category} member."
+    )
+    return None
+
+
+def _counted_array(member_info, args, struct_name):
+    """
+    Turns a `T* items` member annotated with `count(items_count)` into a variable-length array
+    whose element count lives in the named member. Primitive elements other than bool travel as
+    RFC 8746 typed arrays (a tagged byte string of the raw elements).
+    """
+    count_member = args.get(0)
+    if not isinstance(count_member, str) or not count_member.isidentifier():
+        raise ValueError(f"count annotation on '{struct_name}.{member_info['name']}' must name a member")
+    category, type_name = member_info["type_category"], member_info["type_name"]
+    if member_info["flexible"]:
+        category = {"struct": "struct_ptr"}.get(category, category)  # Handled like a pointer to the elements
+    if not (member_info["is_pointer"] or member_info["flexible"]) or category not in ("primitive", "struct_ptr"):
+        logger.warning(
+            f"Ignoring count annotation on '{struct_name}.{member_info['name']}': "
+            f"only pointers to primitives or structs, and flexible array members, can hold a counted array."
+        )
+        return
+    member_info["type_category"] = "counted_array" if category == "primitive" else "counted_struct_array"
+    member_info["count_member"] = count_member
+    # Enums are sent element by element, so that the decoder checks each value
+    member_info["typed_array"] = category == "primitive" and type_name not in BOOL_TYPES and not member_info["enum"]
+
+
+def _attach_control_members(struct_info):
+    """
+    Moves the members that only describe another member onto it, so they aren't sent on their own:
+    the count of a counted array (implied by the encoded array's length) and the discriminant of
+    a union (sent along with the active arm).
+    """
+    for member in list(struct_info["members"]):
+        for annotation, key in (("count", "count_member"), ("discriminant", "discriminant")):
+            if not member[key]:
+                continue
+            control = next((m for m in struct_info["members"] if m["name"] == member[key]), None)
+            is_enum = control is not None and control["enum"] is not None and annotation == "discriminant"
+            if (
+                not control
+                or control["type_category"] != "primitive"
+                or not (control["type_name"] in INTEGER_TYPES or is_enum)
+            ):
+                raise ValueError(
+                    f"{annotation} annotation on '{struct_info['name']}.{member['name']}': "
+                    f"'{member[key]}' is not an integer member of the struct"
+                )
+            member["count_type" if annotation == "count" else "discriminant_type"] = control["type_name"]
+            if is_enum:
+                member["discriminant_enum"] = control["enum"]
+            struct_info["members"].remove(control)
+
+
+# --- Enums ---
+
+ENUM_BITSET_MAX_SPAN = 1024  # Widest value range of a sparse enum checked with a bitset rather than a switch
+
+_ENUM_OPERATORS = {
+    "+": lambda a, b: a + b,
+    "-": lambda a, b: a - b,
+    "*": lambda a, b: a * b,
+    "/": lambda a, b: int(a / b),
+    "%": lambda a, b: a - b * int(a / b),
+    "<<": lambda a, b: a << b,
+    ">>": lambda a, b: a >> b,
+    "|": lambda a, b: a | b,
+    "&": lambda a, b: a & b,
+    "^": lambda a, b: a ^ b,
+}
+
+
+def _enum_constant(node, known):
+    """Evaluates the integer constant expression of an enumerator, given the enumerators before it."""
+    if isinstance(node, c_ast.Constant) and node.type == "char":
+        return ord(node.value.strip("'").encode().decode("unicode_escape"))
+    if isinstance(node, c_ast.Constant):
+        return int(node.value.rstrip("uUlL"), 0)
+    if isinstance(node, c_ast.ID):
+        return known[node.name]
+    if isinstance(node, c_ast.UnaryOp) and node.op in ("-", "+", "~"):
+        value = _enum_constant(node.expr, known)
+        return {"-": -value, "+": value, "~": ~value}[node.op]
+    if isinstance(node, c_ast.BinaryOp) and node.op in _ENUM_OPERATORS:
+        return _ENUM_OPERATORS[node.op](_enum_constant(node.left, known), _enum_constant(node.right, known))
+    if isinstance(node, c_ast.Cast):
+        return _enum_constant(node.expr, known)
+    raise ValueError(f"unsupported enumerator expression {type(node).__name__}")
+
+
+def enum_info(enum_node, c_type, ident):
+    """
+    Describes an enum for the templates: its C type spelling, the identifier its helpers are named
+    after, its enumerators, and how the decoder checks a value: the range [min, max] alone when the
+    enum is dense, plus a bitset of the members over that range, or else a switch, when it is sparse.
+    Returns None if an enumerator's value can't be worked out.
+    """
+    values, known, next_value = [], {}, 0
+    try:
+        for enumerator in enum_node.values.enumerators:
+            value = next_value if enumerator.value is None else _enum_constant(enumerator.value, known)
+            known[enumerator.name] = value
+            values.append((enumerator.name, value))
+            next_value = value + 1
+    except (KeyError, ValueError, ZeroDivisionError) as e:
+        logger.warning(f"Skipping members of type {c_type}: can't evaluate its enumerators ({e}).")
+        return None
+    distinct = sorted(set(known.values()))
+    if not distinct or distinct[0] < -(2**63) or distinct[-1] >= 2**63:
+        logger.warning(f"Skipping members of type {c_type}: it has no enumerators, or values outside int64_t.")
+        return None
+    low, high = distinct[0], distinct[-1]
+    span = high - low + 1
+    bitset = None
+    if len(distinct) != span and span <= ENUM_BITSET_MAX_SPAN:
+        bitset = [0] * ((span + 7) // 8)
+        for value in distinct:
+            bitset[(value - low) // 8] |= 1 << ((value - low) % 8)
+    return {
+        "c_type": c_type,
+        "id": ident,
+        "values": values,
+        "distinct": distinct,
+        "min": low,
+        "max": high,
+        "dense": len(distinct) == span,
+        "bitset": bitset,
+    }
+
+
+def _enum_member(member_info, decl, ast, owner, typedef_name):
+    """Attaches the enum_info of an enum-typed member (or array of them). Returns False if it can't be encoded."""
+    enum_node = _get_base_type_from_decl(decl.type)
+    if enum_node.values is None:
+        enum_node = find_enum(enum_node.name, ast)
+    if enum_node is None:
+        logger.warning(f"Skipping '{owner}.{decl.name}': the definition of its enum isn't in this header.")
+        return False
+    if enum_node.name:
+        c_type, ident = f"enum {enum_node.name}", enum_node.name
+    elif typedef_name:
+        c_type, ident = typedef_name, typedef_name
+    else:
+        c_type, ident = "int", f"{owner.replace('.', '_')}_{decl.name}"  # An inline `enum { ... } member;`
+    member_info["enum"] = enum_info(enum_node, c_type, ident)
+    member_info["type_name"] = c_type
+    return member_info["enum"] is not None
+
+
+def _annotated_decls(decls):
+    """Yields each declaration of a struct or union with the annotations written before it."""
+    pending_annotations = {}
+    for decl in decls or []:
+        if isinstance(decl, c_ast.Pragma):
+            annotation = parse_annotation(decl.string)
+            if annotation:
+                name, args = annotation
+                pending_annotations[name] = args
+            continue
+        yield decl, pending_annotations
+        pending_annotations = {}
+
+
+def _union_arms(member_info, union_node, ast, owner):
+    """
+    Describes the arms of a union member: each is processed like a struct member named
+    `<union>.<arm>` (so member snippets address `data-><union>.<arm>`), and carries the
+    discriminant value that selects it: its `case(<value>)` annotation, or else its position.
+    """
+    arms = []
+    for index, (decl, annotations) in enumerate(_annotated_decls(union_node.decls)):
+        arm = _process_member(decl, annotations, ast, f"{owner}.{member_info['name']}")
+        if arm is None:
+            continue
+        if arm["type_category"] == "union" or arm["count_member"]:
+            logger.warning(
+                f"Skipping '{owner}.{member_info['name']}.{arm['name']}': "
+                f"union arms can't be unions or counted arrays."
+            )
+            continue
+        case = annotations.get("case", {}).get(0, index)
+        if isinstance(case, bool) or not (isinstance(case, int) or str(case).isidentifier()):
+            raise ValueError(
+                f"case annotation on '{owner}.{member_info['name']}.{arm['name']}' must be an integer or a constant name"
+            )
+        arm["case"] = str(case)
+        arm["name"] = f"{member_info['name']}.{arm['name']}"
+        if any(other["case"] == arm["case"] for other in arms):
+            raise ValueError(f"Union '{owner}.{member_info['name']}' has two arms for case {case}")
+        arms.append(arm)
+    return arms
+
+
+def _process_member(decl, annotations, ast, owner):
+    """
+    Builds the template description of one struct (or union) member declared by `decl`, with
+    the annotations written before it. Returns None (with a warning) for members that are skipped.
+    """
+    # The typedef a member is declared with names the type of an anonymous enum
+    spelled = _get_base_type_from_decl(decl.type)
+    typedef_name = " ".join(spelled.names) if isinstance(spelled, c_ast.IdentifierType) else None
+    # Expand typedefs for the member's type before processing
+    # Assign the returned node back to decl.type
+    decl.type = expand_in_place(decl.type, ast)
+    base_type_name, type_category, array_size, is_pointer = get_type_info(decl.type, ast, decl.bitsize)
+
+    member_info = {
+        "name": decl.name,
+        "type_name": base_type_name,
+        "type_category": type_category,
+        "array_size": array_size,
+        "is_pointer": is_pointer,
+        "annotations": annotations,
+        "quantize": None,
+        "bit_width": int(decl.bitsize.value, 0) if type_category == "bitfield" else None,
+        "timeseries": None,
+        "default": None,
+        "count_member": None,  # For counted arrays: the member holding the element count...
+        "count_type": None,  # ...and its type
+        "typed_array": False,
+        "flexible": isinstance(decl.type, c_ast.ArrayDecl) and decl.type.dim is None,  # `T items[];`
+        "dims": None,  # For multi-dimensional arrays: the dimensions, outermost first
+        "discriminant": None,  # For unions: the member selecting the active arm...
+        "discriminant_type": None,  # ...its type (and enum_info, for an enum)...
+        "discriminant_enum": None,
+        "arms": None,  # ...and the arms
+        "enum": None,  # For enums (and arrays of them): the enum_info
+    }
+
+    # Decided on the expanded node: the type of an anonymous struct member has no name to look at
+    if isinstance(_get_base_type_from_decl(decl.type), c_ast.Enum) and type_category in ("primitive", "array"):
+        if not _enum_member(member_info, decl, ast, owner, typedef_name):
+            return None
+
+    if type_category == "multidim_array":
+        if is_pointer or base_type_name not in INTEGER_TYPES + FLOAT_TYPES:
+            logger.warning(
+                f"Skipping '{owner}.{decl.name}': multi-dimensional arrays must hold "
+                f"integers or floats, not {base_type_name}{'*' if is_pointer else ''}."
+            )
+            return None
+        member_info["dims"] = array_dims(decl.type)
+        member_info["typed_array"] = True  # Its elements travel as one RFC 8746 typed array
+
+    if type_category == "union":
+        discriminant = annotations.get("discriminant", {}).get(0)
+        if decl.name is None or is_pointer or array_size is not None or not isinstance(discriminant, str):
+            logger.warning(
+                f"Skipping union '{owner}.{decl.name}': only named, non-array union members "
+                f"with a discriminant annotation naming the member that selects their arm are supported."
+            )
+            return None
+        union_node = _get_base_type_from_decl(decl.type)
+        if union_node.decls is None:
+            union_node = find_struct(union_node.name, ast, c_ast.Union)
+            if union_node is None:
+                logger.warning(f"Skipping union '{owner}.{decl.name}': its definition isn't in this header.")
+                return None
+        member_info["discriminant"] = discriminant
+        member_info["arms"] = _union_arms(member_info, union_node, ast, owner)
+
+    if "quantize" in annotations:
+        if type_category in ("primitive", "array") and base_type_name in FLOAT_TYPES:
+            member_info["quantize"] = _quantize_info(annotations["quantize"], decl.name)
         else:
-            cpp_args_list = cpp_args
+            logger.warning(
+                f"Ignoring quantize annotation on '{owner}.{decl.name}': "
+                f"only float/double members and arrays can be quantized."
+            )
+    if "timeseries" in annotations:
+        member_info["timeseries"] = _timeseries_codec(member_info, owner)
+    if "default" in annotations:
+        member_info["default"] = _default_literal(member_info, annotations["default"].get(0), owner)
+    if "count" in annotations:
+        _counted_array(member_info, annotations["count"], owner)
+    needs_count = (type_category == "primitive" and is_pointer) or member_info["flexible"]
+    if needs_count and not member_info["count_member"]:
+        logger.warning(
+            f"Skipping '{owner}.{decl.name}': "
+            f"{'flexible array members' if member_info['flexible'] else 'pointers to ' + base_type_name} "
+            f"need a count annotation naming the member that holds their element count."
+        )
+        return None
+    return member_info
+
+
+def _key_table(struct_info):
+    """
+    Lays out the CBOR encoding of every member's map key (text string head and name) in one byte
+    table, so the encoder appends each with a single copy. Notes each member's slice of the table,
+    and its bytes as a C string literal.
+    """
+    offset = 0
+    for member in struct_info["members"]:
+        name = member["name"].encode()
+        head = cbor_head(3, len(name))
+        member["key_offset"], member["key_len"] = offset, len(head) + len(name)
+        member["key_literal"] = '"' + "".join(f"\\x{byte:02x}" for byte in head) + f'" "{member["name"]}"'
+        offset += member["key_len"]
+
+
+def process_struct(struct_node, ast):
+    """
+    Builds the template description of a struct: its name and, for every member,
+    the resolved type information plus any annotations attached to it.
+    """
+    struct_info = {"name": struct_node.name, "members": []}
+    for decl, annotations in _annotated_decls(struct_node.decls):
+        member_info = _process_member(decl, annotations, ast, struct_node.name)
+        if member_info is not None:
+            struct_info["members"].append(member_info)
+    _attach_control_members(struct_info)
+    _key_table(struct_info)
+    struct_info["flexible"] = next((m for m in struct_info["members"] if m["flexible"]), None)
+    if struct_info["flexible"] and len(struct_info["members"]) > SEEN_MASK_BITS:
+        raise ValueError(
+            f"Struct '{struct_node.name}' has a flexible array member and more than {SEEN_MASK_BITS} members; "
+            f"its decoder couldn't keep the array's capacity while resetting defaults."
+        )
+    if len(struct_info["members"]) > SEEN_MASK_BITS:
+        logger.warning(
+            f"Struct '{struct_node.name}' has more than {SEEN_MASK_BITS} members; members after the "
+            f"first {SEEN_MASK_BITS} are reset to their defaults before decoding and have no seen-mask bit."
+        )
+    return struct_info
+
+
+def template_features(processed_structs):
+    """
+    Reports which optional helpers the generated C source needs, so that helpers
+    no member uses are left out (and don't trigger unused-function warnings).
+    """
+    members = [member for struct in processed_structs for member in struct["members"]]
+    members += [arm for member in members if member["arms"] for arm in member["arms"]]
+    enums = {info["id"]: info for member in members for info in (member["enum"], member["discriminant_enum"]) if info}
+    return {
+        "uses_quantize": any(member["quantize"] for member in members),
+        "uses_bool_bitmap": any(
+            member["type_category"] == "array" and member["type_name"] in BOOL_TYPES for member in members
+        ),
+        "uses_fixed_layout": any(struct.get("fixed_layout") for struct in processed_structs),
+        "uses_counted_arrays": any(member["count_member"] for member in members),
+        "uses_typed_arrays": any(member["typed_array"] for member in members),
+        "uses_multidim_arrays": any(member["dims"] for member in members),
+        "uses_flexible_arrays": any(struct["flexible"] for struct in processed_structs),
+        "uses_nested_structs": any(
+            member["type_category"] in ("struct", "struct_ptr", "struct_array", "counted_struct_array")
+            for member in members
+        ),
+        # Enums whose values the decoders check, in a stable order
+        "enums": [enums[ident] for ident in sorted(enums)],
+        # Element types that need a time-series kernel, per codec, in a stable order
+        "timeseries_kernels": sorted(
+            {(member["timeseries"], member["type_name"]) for member in members if member["timeseries"]}
+        ),
+    }
+
+
+# --- Fixed Layout ---
+
+# In fixed-layout mode (--fixed-layout) every member is encoded with a head of constant width,
+# so the encoded form of a struct is a constant template in which only the value bytes change.
+# Integers take the argument width of their C type (even if a shorter head would do), which
+# keeps them valid, if not preferred, CBOR.
+FIXED_INTEGER_WIDTHS = {
+    "char": 1,
+    "signed char": 1,
+    "unsigned char": 1,
+    "int8_t": 1,
+    "uint8_t": 1,
+    "short": 2,
+    "unsigned short": 2,
+    "int16_t": 2,
+    "uint16_t": 2,
+    "int": 4,
+    "unsigned int": 4,
+    "int32_t": 4,
+    "uint32_t": 4,
+    "long": 8,  # Wide enough for both ILP32 and LP64
+    "unsigned long": 8,
+    "long long": 8,
+    "unsigned long long": 8,
+    "int64_t": 8,
+    "uint64_t": 8,
+}
+
+
+class _NotFixed(Exception):
+    """Raised for a member that has no fixed-size encoding (pointers, unknown types)."""
+
+
+def cbor_head(major_type, value, width=None):
+    """
+    Returns the bytes of a CBOR head. `width` (1, 2, 4 or 8) forces the argument to be
+    written in that many bytes; otherwise the shortest form is used.
+    """
+    if width is None:
+        if value < 24:
+            return bytes([major_type << 5 | value])
+        width = next(w for w in (1, 2, 4, 8) if value < 1 << (8 * w))
+    return bytes([major_type << 5 | (24 + (1, 2, 4, 8).index(width))]) + value.to_bytes(width, "big")
+
+
+def _fixed_scalar(type_name, quantize, template):
+    """Appends the template bytes of one scalar value and returns its field description."""
+    field = {"offset": len(template)}
+    if quantize:
+        field.update(codec="quantized", width=8, quantize=quantize)
+    elif type_name in BOOL_TYPES:
+        field.update(codec="bool", width=0)
+    elif type_name in ("float", "float_t"):
+        field.update(codec="float", width=4)
+    elif type_name in ("double", "double_t"):
+        field.update(codec="double", width=8)
+    elif type_name in FIXED_INTEGER_WIDTHS:
+        codec = "uint" if type_name in UNSIGNED_INTEGER_TYPES else "int"
+        field.update(codec=codec, width=FIXED_INTEGER_WIDTHS[type_name])
+    else:
+        raise _NotFixed(f"type '{type_name}' has no fixed-width encoding")
 
-        ast = parse_file(tmp_file_path, use_cpp=True, cpp_path=cpp_path, cpp_args=cpp_args_list)
-        return ast
+    if field["codec"] == "bool":
+        template += b"\xf4"
+    elif field["codec"] in ("float", "double"):
+        template += bytes([0xFA if field["codec"] == "float" else 0xFB]) + bytes(field["width"])
+    else:
+        template += cbor_head(0, 0, field["width"])
+    return field
+
+
+def _fixed_struct_fields(struct_info, structs_by_name, template):
+    """Appends the template of a whole struct message and returns the fields of its members."""
+    fields = []
+    template += cbor_head(5, len(struct_info["members"]))
+    for member in struct_info["members"]:
+        name, category, type_name = member["name"], member["type_category"], member["type_name"]
+        template += cbor_head(3, len(name.encode())) + name.encode()
+        if category in ("primitive", "bitfield"):
+            field = _fixed_scalar(type_name, member["quantize"], template)
+            field["kind"] = "scalar"
+        elif category == "char_array":
+            capacity = member["array_size"] - 1  # Room for the terminator isn't sent
+            template += cbor_head(3, capacity)
+            field = {"kind": "text", "offset": len(template), "capacity": capacity}
+            template += bytes(capacity)
+        elif category == "array" and type_name in BOOL_TYPES:
+            bitmap_len = (member["array_size"] + 7) // 8
+            template += cbor_head(2, bitmap_len)
+            field = {"kind": "bitmap", "offset": len(template), "count": member["array_size"]}
+            template += bytes(bitmap_len)
+        elif category == "array":
+            template += cbor_head(4, member["array_size"])
+            element = _fixed_scalar(type_name, member["quantize"], template)
+            stride = len(template) - element["offset"]
+            template += bytes(template[element["offset"] :]) * (member["array_size"] - 1)
+            field = dict(element, kind="array", count=member["array_size"], stride=stride)
+        elif category in ("struct", "struct_array"):
+            nested = structs_by_name.get(type_name)
+            if nested is None:
+                raise _NotFixed(f"struct '{type_name}' is not defined in this header")
+            if category == "struct":
+                field = {"kind": "struct", "fields": _fixed_struct_fields(nested, structs_by_name, template)}
+            else:
+                template += cbor_head(4, member["array_size"])
+                element_template = bytearray()
+                element_fields = _fixed_struct_fields(nested, structs_by_name, element_template)
+                field = {
+                    "kind": "struct_array",
+                    "offset": len(template),
+                    "count": member["array_size"],
+                    "stride": len(element_template),
+                    "fields": element_fields,
+                }
+                template += bytes(element_template) * member["array_size"]
+        else:
+            raise _NotFixed(f"member '{name}' ({category}) has no fixed-size encoding")
+        field.update(name=name, type_name=type_name)
+        fields.append(field)
+    return fields
+
+
+def _fixed_patches(fields, prefix=""):
+    """Lists the fields a patch_<struct>_<member> setter can address: those not inside struct arrays."""
+    patches = []
+    for field in fields:
+        if field["kind"] == "struct":
+            patches += _fixed_patches(field["fields"], f"{prefix}{field['name']}.")
+        elif field["kind"] != "struct_array":
+            patches.append(dict(field, path=prefix + field["name"]))
+    return patches
+
+
+def fixed_layout(struct_info, structs_by_name):
+    """
+    Computes the fixed-layout encoding of a struct: the template bytes of the whole message
+    and where each member's value bytes go. Returns None (with a warning) if some member
+    has no fixed-size encoding.
+    """
+    template = bytearray()
+    try:
+        fields = _fixed_struct_fields(struct_info, structs_by_name, template)
+    except _NotFixed as e:
+        logger.warning(f"No fixed-layout encoder for struct '{struct_info['name']}': {e}")
+        return None
+    return {"size": len(template), "template": list(template), "fields": fields, "patches": _fixed_patches(fields)}
+
+
+# Defined while the generator preprocesses a header, so that `#ifdef AILUROPODA_GENERATOR` can hide
+# annotations from the compiler (GCC's C front end can't silence -Wunknown-pragmas with a pragma)
+GENERATOR_MACRO = "AILUROPODA_GENERATOR"
+
+# Suffixes of already-preprocessed input (e.g. from `cc -E header.h -o header.i`), parsed without cpp
+PREPROCESSED_SUFFIXES = (".i",)
+
+# One parser for every header: pycparser's CParser builds its LALR tables when constructed, and
+# parse() resets all of its per-file state, so an instance can be reused across headers
+_c_parser = None
+
+
+def c_parser():
+    """Returns the shared CParser, creating it on first use."""
+    global _c_parser
+    if _c_parser is None:
+        _c_parser = CParser()
+    return _c_parser
+
+
+def preprocess_c_string(c_code_string, cpp_path=None, cpp_args=None, source_name="<input>"):
+    """
+    Runs the C preprocessor on a C code string and returns its output, with line markers naming
+    `source_name`. The code is streamed through cpp's stdin and stdout, with no temporary file.
+    """
+    # Ensure cpp_args is a list
+    if cpp_args is None:
+        cpp_args_list = []
+    elif isinstance(cpp_args, str):
+        cpp_args_list = [cpp_args]
+    else:
+        cpp_args_list = list(cpp_args)
+
+    # "-" makes cpp read stdin; its errors go to our stderr, as with pycparser's preprocess_file.
+    # AILUROPODA_GENERATOR lets headers show annotations to the generator only (see README).
+    command = [cpp_path or "cpp", f"-D{GENERATOR_MACRO}", *cpp_args_list, "-"]
+    try:
+        result = subprocess.run(command, input=c_code_string, stdout=subprocess.PIPE, text=True, check=True)
+    except OSError as e:
+        raise RuntimeError(f"Unable to invoke '{command[0]}'. Make sure its path was passed correctly\n"
+                           f"Original error: {e}")
+    return result.stdout.replace('"<stdin>"', json.dumps(str(source_name)))
+
+
+def parse_preprocessed(text, source_name="<input>"):
+    """
+    Parses preprocessed C code into a pycparser AST, with the shared parser.
+    """
+    try:
+        return c_parser().parse(text, str(source_name))
     except Exception as e:
-        logger.error(f"Error parsing C code from {tmp_file_path}: {e}")
+        logger.error(f"Error parsing C code from {source_name}: {e}")
         raise
-    finally:
-        Path(tmp_file_path).unlink()  # Use pathlib for file removal
 
 
-def generate_cbor_code(header_file_path, output_dir, cpp_path=None, cpp_args=None):
+def parse_c_string(c_code_string, cpp_path=None, cpp_args=None, source_name="<input>"):
     """
-    Generates CBOR encoding/decoding C code for structs defined in the given header file.
+    Parses a C code string into a pycparser AST, using a C preprocessor.
     """
-    with open(header_file_path, "r") as f:
-        c_code_string = f.read()
+    text = preprocess_c_string(c_code_string, cpp_path=cpp_path, cpp_args=cpp_args, source_name=source_name)
+    return parse_preprocessed(text, source_name)
 
-    logger.info(f"Parsing C header: {header_file_path}")
-    ast = parse_c_string(c_code_string, cpp_path=cpp_path, cpp_args=cpp_args)
 
+def included_files(preprocessed_text):
+    """
+    The files cpp read to produce `preprocessed_text` (the header and everything it included, in
+    order), from its line markers.
+    """
+    files = {}
+    for marker in re.finditer(r'^#\s*(?:line\s+)?\d+\s+("(?:[^"\\]|\\.)*")', preprocessed_text, re.MULTILINE):
+        name = json.loads(marker.group(1))  # cpp escapes '\\' and '"' as C (and JSON) strings do
+        if not name.startswith("<"):  # <built-in>, <command-line>
+            files.setdefault(name)
+    return [Path(name) for name in files]
+
+
+def preprocessed_origin(preprocessed_path, text):
+    """
+    The header a preprocessed file was produced from, for the generated code to include: the file
+    named by its first line marker, or failing that (e.g. `cc -E -P` output) the .h file beside it.
+    """
+    marker = re.match(r'#\s*(?:line\s+)?\d+\s+"([^"<>]+)"', text)
+    if marker:
+        origin = Path(marker.group(1))
+        # A relative name is relative to where cpp ran: try beside the .i file, then here
+        for candidate in (preprocessed_path.parent / origin, origin):
+            if candidate.is_file():
+                return candidate
+    header_path = preprocessed_path.with_suffix(".h")
+    if not header_path.is_file():
+        logger.warning(f"{preprocessed_path} names no existing header; the generated code includes {header_path}")
+    return header_path
+
+
+def find_structs_to_generate(ast):
+    """
+    Returns the struct nodes to generate code for: the named structs with members that are
+    declared at file scope, directly or through a typedef.
+    """
     structs_to_generate = []
     for ext in ast.ext:
         if isinstance(ext, c_ast.Decl) and isinstance(ext.type, c_ast.Struct):
@@ -260,56 +1106,335 @@ def generate_cbor_code(header_file_path, output_dir, cpp_path=None, cpp_args=Non
             # Only process named typedef structs with declarations
             if struct_node.name and struct_node.decls:
                 structs_to_generate.append(struct_node)
+    return structs_to_generate
 
-    processed_structs = []
-    for struct_node in structs_to_generate:
-        struct_info = {"name": struct_node.name, "members": []}
-        if struct_node.decls:
-            for decl in struct_node.decls:
-                # Expand typedefs for the member's type before processing
-                # Assign the returned node back to decl.type
-                decl.type = expand_in_place(decl.type, ast)
-                base_type_name, type_category, array_size, is_pointer = get_type_info(decl.type, ast)
-
-                member_info = {
-                    "name": decl.name,
-                    "type_name": base_type_name,
-                    "type_category": type_category,
-                    "array_size": array_size,
-                    "is_pointer": is_pointer,
-                }
-                struct_info["members"].append(member_info)
-        processed_structs.append(struct_info)
+
+def write_if_changed(path, content):
+    """
+    Writes `content` to `path` unless the file already holds exactly that, so that regenerating
+    unchanged code leaves its timestamp alone and make/ninja don't rebuild it. Returns whether
+    the file was written.
+    """
+    if path.is_file() and path.read_text() == content:
+        logger.info(f"Unchanged {path}")
+        return False
+    path.write_text(content)
+    logger.info(f"Generated {path}")
+    return True
+
+
+CACHE_FILE_NAME = ".ailuropoda_cache.json"  # In the output directory
+STAMP_FILE_NAME = "cbor_generated.stamp"  # In the output directory, the target of --depfile
+
+
+def write_depfile(depfile_path, target, dependencies):
+    """
+    Writes a Makefile-syntax depfile (as `cc -MD` does) stating that `target` depends on
+    `dependencies`, for make, ninja or CMake's add_custom_command(DEPFILE) to track.
+    """
+
+    def escape(path):
+        return str(path.absolute()).replace("$", "$$").replace("#", "\\#").replace(" ", "\\ ")
+
+    lines = [f"{escape(target)}:"] + [f" {escape(dependency)}" for dependency in dependencies]
+    write_if_changed(Path(depfile_path), " \\\n".join(lines) + "\n")
+
+
+def _digest(value):
+    """Stable hash of a JSON-like value (values JSON can't represent are hashed by their repr)."""
+    return hashlib.sha256(json.dumps(value, sort_keys=True, default=repr).encode()).hexdigest()
+
+
+def generator_fingerprint(templates_dir):
+    """Hash of the generator's code and templates: output cached by another version is not reused."""
+    fingerprint = hashlib.sha256(Path(__file__).read_bytes())
+    for template in sorted(templates_dir.glob("*.jinja")):
+        fingerprint.update(template.name.encode() + b"\0" + template.read_bytes())
+    return fingerprint.hexdigest()
+
+
+class GenerationCache:
+    """
+    What the previous run in an output directory produced, so that a rerun can skip the work whose
+    inputs didn't change: the processed structs of each preprocessed header (skipping its parse),
+    and the inputs of every generated file (skipping its rendering). Everything is tied to the
+    generator's fingerprint. A missing or unreadable cache file just means starting afresh.
+    """
+
+    def __init__(self, path, fingerprint):
+        self.path = path
+        self.fingerprint = fingerprint
+        try:
+            cached = json.loads(path.read_text())
+        except (OSError, ValueError):
+            cached = {}
+        if fingerprint is None or not isinstance(cached, dict) or cached.get("fingerprint") != fingerprint:
+            cached = {}
+        self.parsed = cached.get("parsed", {})  # Header path -> {"key": text digest, "structs": [...]}
+        self.files = cached.get("files", {})
+        self.analyzed = {}
+        self.emitted = {}
+
+    def parsed_key(self, header_file_path):
+        """The digest of the preprocessed text of the header's cached structs, or None."""
+        return self.parsed.get(str(header_file_path), {}).get("key")
+
+    def structs(self, header_file_path, key, structs=None):
+        """
+        Returns the processed structs of the header whose preprocessed text has the digest `key`:
+        `structs`, or if that is None, the cached ones (for which `key` must be parsed_key's).
+        """
+        entry = {"key": key, "structs": structs} if structs is not None else self.parsed[str(header_file_path)]
+        self.analyzed[str(header_file_path)] = entry
+        # A copy as it round-trips through JSON: the caller may amend it, and a run from the cache
+        # renders exactly what the run that filled it did
+        return json.loads(json.dumps(entry["structs"], default=repr))
+
+    def emit(self, path, inputs, render):
+        """
+        Writes the file at `path` with the text `render()` returns, unless the cached file was
+        generated from the same `inputs` and is still as generated, in which case it isn't rendered.
+        """
+        key = _digest(inputs)
+        entry = self.files.get(path.name)
+        if entry and entry["inputs"] == key and path.is_file() and _digest(path.read_text()) == entry["content"]:
+            logger.info(f"Unchanged {path}")
+            self.emitted[path.name] = entry
+            return
+        content = render()
+        write_if_changed(path, content)
+        self.emitted[path.name] = {"inputs": key, "content": _digest(content)}
+
+    def save(self):
+        """Records this run: its headers' structs and the files it emitted (forgetting any others)."""
+        cached = {"fingerprint": self.fingerprint, "parsed": self.analyzed, "files": self.emitted}
+        write_if_changed(self.path, json.dumps(cached, sort_keys=True))
+
+
+def analyze_header(header_file_path, cached_key=None, cpp_path=None, cpp_args=None):
+    """
+    Preprocesses a header, then parses it and processes the structs to generate code for, unless
+    its preprocessed text has the digest `cached_key` (that of the cached structs). Returns the
+    header the generated code includes, the digest, the structs (None when not parsed) and the
+    files the generated code depends on.
+    Runs in a worker process when generate_cbor_code is given several headers.
+    """
+    header_file_path = Path(header_file_path)
+    c_code_string = header_file_path.read_text()
+    if header_file_path.suffix in PREPROCESSED_SUFFIXES:
+        preprocessed = c_code_string
+        included_header_path = preprocessed_origin(header_file_path, preprocessed)
+        dependencies = [header_file_path]
+    else:
+        logger.info(f"Preprocessing C header: {header_file_path}")
+        # cpp reads the header from stdin, so tell it where #include "..." looks first
+        if cpp_args is None:
+            cpp_args = []
+        elif isinstance(cpp_args, str):
+            cpp_args = [cpp_args]
+        cpp_args = [*cpp_args, "-iquote", str(header_file_path.parent)]
+        preprocessed = preprocess_c_string(
+            c_code_string, cpp_path=cpp_path, cpp_args=cpp_args, source_name=header_file_path
+        )
+        included_header_path = header_file_path
+        dependencies = included_files(preprocessed)
+
+    key = _digest(preprocessed)
+    if key == cached_key:
+        logger.info(f"{header_file_path} unchanged since the last run; reusing its structs")
+        return included_header_path, key, None, dependencies
+    logger.info(f"Parsing C header: {header_file_path}")
+    ast = parse_preprocessed(preprocessed, header_file_path)
+    structs = [process_struct(struct_node, ast) for struct_node in find_structs_to_generate(ast)]
+    return included_header_path, key, structs, dependencies
+
+
+def merge_structs(structs_by_header):
+    """
+    Joins the structs of several headers into one list, in order, keeping each struct once: headers
+    that include a common header all define its structs. Raises ValueError if two headers define
+    a struct of the same name differently, as the generated functions could only encode one.
+    """
+    merged = {}
+    for header_file_path, structs in structs_by_header:
+        for struct in structs:
+            first_header, first = merged.setdefault(struct["name"], (header_file_path, struct))
+            if first != struct:
+                raise ValueError(
+                    f"struct {struct['name']} is defined differently in {first_header} and {header_file_path}"
+                )
+    return [struct for _, struct in merged.values()]
+
+
+def read_manifest(manifest_path):
+    """
+    The headers listed in a manifest file, one per line, relative to the manifest's directory.
+    Blank lines and lines starting with '#' are skipped.
+    """
+    headers = []
+    for line in Path(manifest_path).read_text().splitlines():
+        line = line.strip()
+        if line and not line.startswith("#"):
+            headers.append(Path(manifest_path).parent / line)
+    return headers
+
+
+@functools.lru_cache(maxsize=None)
+def template_environment(templates_dir):
+    """
+    The Jinja2 environment of the templates in `templates_dir`, created once per process: it keeps
+    the templates it compiled (recompiling one only when its file changes), which saves most of
+    the cost of a rerun in the same process (see --watch).
+    """
+    env = Environment(loader=FileSystemLoader(templates_dir), trim_blocks=True, lstrip_blocks=True)
+    env.globals["signed_integer_types"] = SIGNED_INTEGER_TYPES
+    env.globals["integer_limits"] = INTEGER_LIMITS
+    env.globals["seen_mask_bits"] = SEEN_MASK_BITS
+    env.globals["timeseries_max_payload"] = TIMESERIES_MAX_PAYLOAD
+    return env
+
+
+def generate_cbor_code(
+    header_file_path,
+    output_dir,
+    cpp_path=None,
+    cpp_args=None,
+    stringref=False,
+    fixed_layout_mode=False,
+    enum_names=False,
+    trusted=False,
+    streaming=False,
+    delta=False,
+    header_only=False,
+    structs_per_file=0,
+    use_cache=True,
+    jobs=None,
+    depfile=None,
+):
+    """
+    Generates CBOR encoding/decoding C code for structs defined in the given header file, or in
+    each of a list of header files. Several headers are preprocessed and parsed in parallel, in
+    up to `jobs` worker processes (by default, one per CPU), and generate one set of files for all
+    of their structs, each struct once.
+    With `stringref`, also generates encode_X_stringref/decode_X_stringref, which deduplicate
+    repeated strings using the stringref tags (25/256). With `fixed_layout_mode`, also generates
+    encode_X_fixed and patch_X_<member> for structs whose encoding can have a constant layout.
+    With `enum_names`, also generates E_name/E_from_name for every enum the structs use.
+    With `trusted`, also generates validate_X and decode_X_trusted, which decode validated messages
+    without per-value checks. With `streaming`, also generates encode_X_stream_*/decode_X_stream_*,
+    which write and read an indefinite-length array of X one record at a time. With `delta`, also
+    generates encode_X_delta/apply_X_delta, which send only the members that changed.
+    With `header_only`, the functions are static inline and defined in cbor_generated.h, with no
+    cbor_generated.c. With `structs_per_file`, the functions of every that many structs go into a
+    file of their own (cbor_generated_<first struct>.c), so they compile in parallel and only the
+    files whose code changed are rebuilt. Files whose content is unchanged are never rewritten.
+    With `use_cache`, a cache in `output_dir` lets a rerun skip parsing the headers whose
+    preprocessed text didn't change, and rendering the files whose inputs didn't change.
+    A header file ending in .i is taken as already preprocessed and parsed without running cpp; the
+    generated code then includes the header named by its first line marker.
+    With `depfile`, writes there the files cpp read (the headers and all they include) as the
+    dependencies of cbor_generated.stamp, which it touches, for the build system to rerun the
+    generator only when one of them changes.
+    Returns the files cpp read: those that the generated code depends on.
+    """
+    if isinstance(header_file_path, (str, Path)):
+        header_file_paths = [Path(header_file_path)]
+    else:
+        header_file_paths = [Path(path) for path in header_file_path]
 
     # Setup Jinja2 environment
     # Corrected path: go up three levels from cbor_codegen.py to reach project root, then into 'templates'
     templates_dir = Path(__file__).parent.parent.parent / "templates"
     project_root = Path(__file__).parent.parent.parent  # Get project root for dependency.cmake
-    env = Environment(loader=FileSystemLoader(templates_dir), trim_blocks=True, lstrip_blocks=True)
+    env = template_environment(templates_dir)
+    cache = GenerationCache(output_dir / CACHE_FILE_NAME, generator_fingerprint(templates_dir) if use_cache else None)
+
+    cached_keys = [cache.parsed_key(path) for path in header_file_paths]
+    analyze = functools.partial(analyze_header, cpp_path=cpp_path, cpp_args=cpp_args)
+    if len(header_file_paths) > 1 and jobs != 1:
+        with concurrent.futures.ProcessPoolExecutor(max_workers=jobs) as pool:
+            analyzed = list(pool.map(analyze, header_file_paths, cached_keys))
+    else:
+        analyzed = list(map(analyze, header_file_paths, cached_keys))
+
+    included_header_paths = []
+    structs_by_header = []
+    dependencies = {}
+    for path, (included_header_path, key, structs, header_dependencies) in zip(header_file_paths, analyzed):
+        included_header_paths.append(included_header_path)
+        structs_by_header.append((path, cache.structs(path, key, structs)))
+        dependencies.update(dict.fromkeys(header_dependencies))
+    processed_structs = merge_structs(structs_by_header)
+    if fixed_layout_mode:
+        structs_by_name = {struct["name"]: struct for struct in processed_structs}
+        for struct in processed_structs:
+            struct["fixed_layout"] = fixed_layout(struct, structs_by_name)
 
     # Copy dependency.cmake to the output directory
     dependency_cmake_src = project_root / "dependency.cmake"
     dependency_cmake_dest = output_dir / "dependency.cmake"
     if dependency_cmake_src.exists():
-        shutil.copy(dependency_cmake_src, dependency_cmake_dest)
-        logger.info(f"Copied {dependency_cmake_src.name} to {output_dir}")
+        write_if_changed(dependency_cmake_dest, dependency_cmake_src.read_text())
     else:
         logger.warning(f"dependency.cmake not found at {dependency_cmake_src}. Skipping copy.")
 
-    # Render C header file
-    header_template = env.get_template("cbor_generated.h.jinja")
-    # Pass the original header file path as an absolute path, as relative_to with walk_up is not universally available.
-    rendered_header = header_template.render(
-        structs=processed_structs, original_header_path=header_file_path.absolute()
+    render_args = dict(
+        structs=processed_structs,
+        stringref=stringref,
+        fixed_layout_mode=fixed_layout_mode,
+        enum_names=enum_names,
+        trusted=trusted,
+        streaming=streaming,
+        delta=delta,
+        header_only=header_only,
+        api="static inline " if header_only else "",
+        **template_features(processed_structs),
     )
-    (output_dir / "cbor_generated.h").write_text(rendered_header)
-    logger.info(f"Generated {output_dir / 'cbor_generated.h'}")
 
-    # Render C source file
-    c_template = env.get_template("cbor_generated.c.jinja")
-    rendered_c = c_template.render(structs=processed_structs)
-    (output_dir / "cbor_generated.c").write_text(rendered_c)
-    logger.info(f"Generated {output_dir / 'cbor_generated.c'}")
+    # Each file is rendered from `render_args` (structs, options and template features), and the ones
+    # listed with it are its inputs, which decide whether the cached file is current. Templates are
+    # only compiled (the bulk of a run that renders little) when a file does need rendering.
+    def render_c(part, **overrides):
+        return lambda: env.get_template("cbor_generated.c.jinja").render(part=part, **{**render_args, **overrides})
+
+    # Render C source file(s). With --header-only, the code goes into the header instead.
+    c_files = []
+    if structs_per_file and not header_only:
+        # Only the struct groups render `structs`; the rest depends on the options and features
+        shared_args = {**render_args, "structs": None}
+        cache.emit(
+            output_dir / "cbor_generated_internal.h",
+            ["helpers", shared_args],
+            lambda: env.get_template("cbor_generated_internal.h.jinja").render(helpers=render_c("helpers")()),
+        )
+        c_files.append("cbor_generated.c")
+        cache.emit(output_dir / c_files[-1], ["common", shared_args], render_c("common"))
+        # So editing a struct only re-renders the file of its group
+        for start in range(0, len(processed_structs), structs_per_file):
+            group = processed_structs[start : start + structs_per_file]
+            c_files.append(f"cbor_generated_{group[0]['name']}.c")
+            cache.emit(output_dir / c_files[-1], ["structs", group, shared_args], render_c("structs", structs=group))
+    elif not header_only:
+        c_files.append("cbor_generated.c")
+        cache.emit(output_dir / c_files[-1], [None, render_args], render_c(None))
+    # Drop the split files of an earlier run that no longer exist
+    for stale in output_dir.glob("cbor_generated_*.c"):
+        if stale.name not in c_files:
+            stale.unlink()
+            logger.info(f"Removed {stale}")
+
+    # Render C header file
+    # Pass the original header file paths as absolute paths, as relative_to with walk_up is not universally available.
+    original_header_paths = list(dict.fromkeys(str(path.absolute()) for path in included_header_paths))
+    cache.emit(
+        output_dir / "cbor_generated.h",
+        ["header", original_header_paths, render_args],
+        lambda: env.get_template("cbor_generated.h.jinja").render(
+            original_header_paths=original_header_paths,
+            implementation=render_c(None)() if header_only else None,
+            **render_args,
+        ),
+    )
 
     # Render CMakeLists.txt
     cmake_template = env.get_template("CMakeLists.txt.jinja")
@@ -319,19 +1444,42 @@ def generate_cbor_code(header_file_path, output_dir, cpp_path=None, cpp_args=Non
     rendered_cmake = cmake_template.render(
         generated_library_name="cbor_generated",
         generated_c_file_name="cbor_generated.c",
+        generated_c_file_names=c_files,
         test_harness_c_file_name=None,  # Not generating test harness here
         test_harness_executable_name=None,  # Not generating test harness here
+        header_only=header_only,
     )
-    (output_dir / "CMakeLists.txt").write_text(rendered_cmake)
-    logger.info(f"Generated {output_dir / 'CMakeLists.txt'}")
+    write_if_changed(output_dir / "CMakeLists.txt", rendered_cmake)
+    if use_cache:
+        cache.save()
+    if depfile:
+        write_depfile(depfile, output_dir / STAMP_FILE_NAME, dependencies)
+        # Touched even when no file changed: it tells the build system this run happened
+        (output_dir / STAMP_FILE_NAME).touch()
+    return list(dependencies)
 
 
-def main():
+def build_argument_parser():
     parser = argparse.ArgumentParser(description="Generate CBOR encoding/decoding C code for structs.")
     parser.add_argument(
-        "header_file",
+        "header_files",
         type=Path,
-        help="Path to the C header file containing struct definitions.",
+        nargs="*",
+        help="Paths to the C header files containing struct definitions, or to their preprocessed output "
+        "(.i files, e.g. from `cc -E`), which are parsed without running cpp. One set of files is "
+        "generated for the structs of all of them.",
+    )
+    parser.add_argument(
+        "--manifest",
+        type=Path,
+        help="File listing more header files, one per line, relative to its directory ('#' starts a comment line).",
+    )
+    parser.add_argument(
+        "--jobs",
+        "-j",
+        type=int,
+        default=None,
+        help="Number of worker processes that parse the headers. Defaults to the number of CPUs.",
     )
     parser.add_argument(
         "--output-dir",
@@ -345,24 +1493,403 @@ def main():
         default="cpp",
         help="Path to the C preprocessor (cpp) executable. Defaults to 'cpp'.",
     )
+    parser.add_argument(
+        "--stringref",
+        action="store_true",
+        help="Also generate encode_<struct>_stringref/decode_<struct>_stringref, which replace repeated "
+        "strings with stringref (tag 25) back-references.",
+    )
+    parser.add_argument(
+        "--fixed-layout",
+        action="store_true",
+        help="Also generate encode_<struct>_fixed, which fills in a precomputed constant-layout message, "
+        "and patch_<struct>_<member> setters that update one value in an encoded buffer.",
+    )
+    parser.add_argument(
+        "--enum-names",
+        action="store_true",
+        help="Also generate <enum>_name/<enum>_from_name, which map the values of each enum the structs "
+        "use to their enumerator names and back (for logging and debugging).",
+    )
+    parser.add_argument(
+        "--trusted",
+        action="store_true",
+        help="Also generate validate_<struct> and decode_<struct>_trusted, which check a message once and "
+        "then decode it without per-value type checks.",
+    )
+    parser.add_argument(
+        "--streaming",
+        action="store_true",
+        help="Also generate encode_<struct>_stream_begin/append/end and decode_<struct>_stream_begin/end, "
+        "which write and read an indefinite-length array of records one record at a time.",
+    )
+    parser.add_argument(
+        "--delta",
+        action="store_true",
+        help="Also generate encode_<struct>_delta and apply_<struct>_delta, which send only the members "
+        "that changed since a previous snapshot.",
+    )
+    parser.add_argument(
+        "--header-only",
+        action="store_true",
+        help="Generate the functions as static inline definitions in cbor_generated.h instead of "
+        "cbor_generated.c, so calls can be inlined across translation units without LTO.",
+    )
+    parser.add_argument(
+        "--structs-per-file",
+        type=int,
+        default=0,
+        metavar="N",
+        help="Split the generated code into one .c file per N structs (plus cbor_generated.c), so large "
+        "schemas build in parallel and incrementally. By default all of it goes into cbor_generated.c.",
+    )
+    parser.add_argument(
+        "--depfile",
+        type=Path,
+        help=f"Write a depfile listing every file the C preprocessor read as the dependencies of "
+        f"{STAMP_FILE_NAME} in the output directory (touched on every run), for build systems to rerun "
+        f"the generator only when one changes (see ailuropoda_generate in cmake/Modules/Ailuropoda.cmake).",
+    )
+    parser.add_argument(
+        "--no-cache",
+        action="store_true",
+        help=f"Always parse the header and render every file, ignoring and not updating the cache that "
+        f"lets reruns skip unchanged work ({CACHE_FILE_NAME} in the output directory).",
+    )
+    parser.add_argument(
+        "--watch",
+        action="store_true",
+        help="Keep running, and regenerate whenever one of the files the headers include changes "
+        "(noticed through inotify on Linux, by polling elsewhere).",
+    )
+    parser.add_argument(
+        "--socket",
+        type=Path,
+        help="Keep running, and generate code for the requests sent to this Unix socket (see serve_request).",
+    )
     parser.add_argument(
         "--cpp-args",
         nargs=argparse.REMAINDER,
         default=[],
         help="Additional arguments to pass to the C preprocessor (e.g., -I<include_path>).",
     )
+    return parser
 
-    args = parser.parse_args()
 
-    if not args.header_file.is_file():
-        logger.error(f"Error: Header file not found at {args.header_file}")
-        sys.exit(1)
+def generate_from_args(args):
+    """
+    Generates the code that parsed command-line arguments ask for. Returns the files cpp read, and
+    raises FileNotFoundError for a missing header or manifest.
+    """
+    header_files = list(args.header_files)
+    if args.manifest:
+        if not args.manifest.is_file():
+            raise FileNotFoundError(f"Manifest not found at {args.manifest}")
+        header_files += read_manifest(args.manifest)
+    if not header_files:
+        raise FileNotFoundError("No header files given")
+    for header_file in header_files:
+        if not header_file.is_file():
+            raise FileNotFoundError(f"Header file not found at {header_file}")
 
     args.output_dir.mkdir(parents=True, exist_ok=True)
+    return generate_cbor_code(
+        header_files,
+        args.output_dir,
+        args.cpp_path,
+        args.cpp_args,
+        stringref=args.stringref,
+        fixed_layout_mode=args.fixed_layout,
+        enum_names=args.enum_names,
+        trusted=args.trusted,
+        streaming=args.streaming,
+        delta=args.delta,
+        header_only=args.header_only,
+        structs_per_file=args.structs_per_file,
+        use_cache=not args.no_cache,
+        jobs=args.jobs,
+        depfile=args.depfile,
+    )
+
+
+# --- Watch mode and generator server ---
+# A long-running generator keeps what a new process would pay for again on every run: the Python
+# startup, the pycparser and Jinja2 imports, the parser and the compiled templates.
+
+IN_CLOSE_WRITE, IN_MOVED_TO, IN_CREATE, IN_DELETE = 0x8, 0x80, 0x100, 0x200
+
+
+class InotifyWatcher:
+    """
+    Reports changes to a set of files through Linux inotify. It watches their directories rather
+    than the files, so that it still sees a file that an editor saves by replacing it.
+    """
+
+    def __init__(self):
+        self.libc = ctypes.CDLL(None, use_errno=True)
+        self.fd = self.libc.inotify_init1(os.O_NONBLOCK | os.O_CLOEXEC)
+        if self.fd < 0:
+            raise OSError(ctypes.get_errno(), "inotify_init1 failed")
+        self.directories = {}  # Watch descriptor -> directory
+        self.files = set()
+
+    def fileno(self):
+        return self.fd
+
+    def watch(self, paths):
+        """Reports changes to `paths` from now on (instead of the earlier ones)."""
+        self.files = {Path(path).absolute() for path in paths}
+        mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE
+        for directory in {path.parent for path in self.files} - set(self.directories.values()):
+            descriptor = self.libc.inotify_add_watch(self.fd, os.fsencode(directory), mask)
+            if descriptor >= 0:
+                self.directories[descriptor] = directory
+
+    def changes(self):
+        """Returns the watched files changed since the last call (without waiting)."""
+        changed = set()
+        while True:
+            try:
+                data = os.read(self.fd, 64 * 1024)
+            except BlockingIOError:
+                return changed
+            offset = 0
+            while offset < len(data):  # struct inotify_event { int wd; uint32_t mask, cookie, len; char name[]; }
+                descriptor, _, _, length = unpack_from("iIII", data, offset)
+                name = data[offset + 16 : offset + 16 + length].rstrip(b"\0")
+                offset += 16 + length
+                if descriptor in self.directories:
+                    path = self.directories[descriptor] / os.fsdecode(name)
+                    if path in self.files:
+                        changed.add(path)
+
+
+class PollingWatcher:
+    """Reports changes to a set of files by comparing their modification times, where there's no inotify."""
+
+    interval = 0.5  # Seconds between checks
+
+    def __init__(self):
+        self.stamps = {}
+
+    def fileno(self):
+        return None
+
+    @staticmethod
+    def _stamp(path):
+        try:
+            status = path.stat()
+            return status.st_mtime_ns, status.st_size
+        except OSError:
+            return None
+
+    def watch(self, paths):
+        self.stamps = {Path(path).absolute(): self._stamp(Path(path).absolute()) for path in paths}
+
+    def changes(self):
+        changed = {path for path, stamp in self.stamps.items() if self._stamp(path) != stamp}
+        self.stamps.update({path: self._stamp(path) for path in changed})
+        return changed
+
+
+def file_watcher():
+    """An InotifyWatcher on Linux, otherwise a PollingWatcher."""
+    if sys.platform.startswith("linux"):
+        try:
+            return InotifyWatcher()
+        except (OSError, AttributeError) as e:
+            logger.warning(f"inotify unavailable ({e}); polling for changes instead")
+    return PollingWatcher()
+
+
+REQUEST_TIMEOUT = 5.0  # Seconds a client gets to send its request, and to take the reply
+REQUEST_MAX_SIZE = 1 << 20
+
+
+def serve_request(connection, request_line, parser, cpp_path="cpp"):
+    """
+    Handles one request to the generator server. A request is one line of JSON, such as
+    {"cwd": "/src", "args": ["msg.h", "--output-dir", "gen"]}: the command-line arguments of a
+    generator run, with relative paths taken from `cwd`. The response is one line of JSON too,
+    {"ok": true, "seconds": 0.004} or {"ok": false, "error": "..."}, after which the connection is
+    closed. Requests run the server's `cpp_path`: a client can't choose the program to run.
+    """
+    start = time.perf_counter()
+    with connection:
+        try:
+            request = json.loads(request_line)
+            try:
+                # cpp_path stays None unless the request names one, abbreviated or not
+                args = parser.parse_args(
+                    [str(arg) for arg in request["args"]], namespace=argparse.Namespace(cpp_path=None)
+                )
+            except SystemExit:  # argparse reports errors by exiting
+                raise ValueError(f"Invalid arguments: {request['args']}")
+            if args.watch or args.socket:
+                raise ValueError("--watch and --socket can't be requested")
+            if args.cpp_path is not None:
+                raise ValueError("--cpp-path can't be requested")
+            args.cpp_path = cpp_path
+            cwd = Path(request.get("cwd", "."))
+            args.header_files = [cwd / path for path in args.header_files]
+            for name in ("manifest", "output_dir", "depfile"):
+                if getattr(args, name) is not None:
+                    setattr(args, name, cwd / getattr(args, name))
+            generate_from_args(args)
+            response = {"ok": True, "seconds": round(time.perf_counter() - start, 6)}
+        except Exception as e:
+            logger.error(f"Request failed: {e}")
+            response = {"ok": False, "error": str(e)}
+        try:
+            connection.settimeout(REQUEST_TIMEOUT)
+            connection.sendall(json.dumps(response).encode() + b"\n")
+        except OSError as e:  # The client left or stopped reading; the next one shouldn't wait
+            logger.warning(f"Couldn't send the reply: {e}")
+
+
+def bind_server_socket(path):
+    """
+    Listens on the Unix socket `path`. A socket file left there by a server that didn't exit
+    cleanly is replaced, but not one that a running server still accepts connections on.
+    """
+    if path.is_socket():
+        with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as probe:
+            try:
+                probe.connect(str(path))
+            except ConnectionRefusedError:
+                path.unlink()
+            else:
+                raise RuntimeError(f"Another server is listening on {path}")
+    server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    server.bind(str(path))
+    server.listen()
+    server.setblocking(False)
+    return server
+
+
+def command_line_inputs(args):
+    """The headers and manifest that `args` name, which --watch follows even when cpp never got to read them."""
+    inputs = list(args.header_files)
+    if args.manifest:
+        inputs.append(args.manifest)
+        try:
+            inputs += read_manifest(args.manifest)
+        except OSError:
+            pass  # Read again once it changes
+    return inputs
+
+
+def watch_and_serve(args, parser):
+    """
+    Runs until interrupted. With --watch, generates the code for `args` and regenerates it whenever
+    a file the headers include changes. With --socket, serves generator requests (see serve_request)
+    on that Unix socket.
+    """
+    selector = selectors.DefaultSelector()
+    server = None
+    pending = {}  # Connection -> (the request so far, the time it has to arrive by)
+    if args.socket:
+        try:
+            server = bind_server_socket(args.socket)
+        except (OSError, RuntimeError) as e:
+            logger.error(f"Can't serve on {args.socket}: {e}")
+            sys.exit(1)
+        selector.register(server, selectors.EVENT_READ)
+        logger.info(f"Serving generator requests on {args.socket}")
+
+    watcher = None
+    dependencies = set()  # The files the last successful run read
+
+    def regenerate():
+        """Generates the code for `args`, and returns the files to watch for the next run."""
+        nonlocal dependencies
+        start = time.perf_counter()
+        try:
+            dependencies = set(generate_from_args(args))
+            logger.info(f"Generated in {(time.perf_counter() - start) * 1000:.0f} ms")
+        except Exception as e:  # E.g. a syntax error: report it and wait for the fix
+            logger.error(f"CBOR code generation failed: {e}")
+        return {Path(path).absolute() for path in dependencies | set(command_line_inputs(args))}
+
+    if args.watch:
+        watcher = file_watcher()
+        watched = regenerate()
+        watcher.watch(watched)
+        if watcher.fileno() is not None:
+            selector.register(watcher, selectors.EVENT_READ)
+        logger.info(f"Watching {len(watched)} files for changes")
+
+    def drop(connection):
+        selector.unregister(connection)
+        del pending[connection]
 
     try:
-        generate_cbor_code(args.header_file, args.output_dir, args.cpp_path, args.cpp_args)
+        while True:
+            # Wake up for the watcher's next poll and for the first request that runs out of time
+            timeouts = [deadline - time.monotonic() for _, deadline in pending.values()]
+            if getattr(watcher, "interval", None) is not None:
+                timeouts.append(watcher.interval)
+            timeout = max(0, min(timeouts)) if timeouts else None
+            ready = {key.fileobj for key, _ in selector.select(timeout)}
+            if watcher is not None and (watcher in ready or watcher.fileno() is None):
+                changed = watcher.changes()
+                if changed:
+                    time.sleep(0.02)  # Let the rest of a multi-file save land, then take it in one run
+                    changed |= watcher.changes()
+                    logger.info(f"Changed: {', '.join(sorted(map(str, changed)))}")
+                    watcher.watch(regenerate())
+            if server in ready:
+                try:
+                    connection, _ = server.accept()
+                except BlockingIOError:  # The client gave up before we got to it
+                    pass
+                else:
+                    # Read without blocking, so that a slow client doesn't hold up the others
+                    connection.setblocking(False)
+                    selector.register(connection, selectors.EVENT_READ)
+                    pending[connection] = (bytearray(), time.monotonic() + REQUEST_TIMEOUT)
+            for connection in [c for c in pending if c in ready]:
+                request, _ = pending[connection]
+                try:
+                    data = connection.recv(65536)
+                except BlockingIOError:
+                    continue
+                except OSError:
+                    data = b""
+                request += data
+                if b"\n" in request:
+                    drop(connection)
+                    serve_request(connection, request[: request.index(b"\n")], parser, args.cpp_path)
+                elif not data or len(request) > REQUEST_MAX_SIZE:
+                    drop(connection)
+                    connection.close()
+            for connection in [c for c, (_, deadline) in pending.items() if deadline <= time.monotonic()]:
+                logger.warning("Closing a connection that sent no request in time")
+                drop(connection)
+                connection.close()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        for connection in list(pending):
+            connection.close()
+        if server is not None:
+            server.close()
+            args.socket.unlink()
+
+
+def main():
+    parser = build_argument_parser()
+    args = parser.parse_args()
+    if args.watch or args.socket:
+        watch_and_serve(args, parser)
+        return
+
+    try:
+        generate_from_args(args)
         logger.info("CBOR code generation completed successfully.")
+    except FileNotFoundError as e:
+        logger.error(f"Error: {e}")
+        sys.exit(1)
     except Exception as e:
         logger.error(f"CBOR code generation failed: {e}")
         sys.exit(1)
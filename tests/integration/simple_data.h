@@ -20,4 +20,138 @@ struct NestedData {
     int32_t value;
 };
 
+// Successive readings of a sensor, sent as deltas
+struct SensorSnapshot {
+    uint32_t sequence;
+    int16_t samples[16];
+    struct SimpleData status;
+};
+
+// A log record with a variable-length payload, sent as a stream of records
+struct LogRecord {
+    uint32_t timestamp;
+#ifdef AILUROPODA_GENERATOR // Only the generator sees the annotation, so -Wall doesn't warn about it
+    #pragma ailuropoda count(sample_count)
+#endif
+    int32_t* samples;
+    uint16_t sample_count;
+};
+
+// A trace whose arrays are sent time-series compressed
+struct SensorTrace {
+#ifdef AILUROPODA_GENERATOR
+    #pragma ailuropoda timeseries
+#endif
+    int64_t timestamps[8];
+#ifdef AILUROPODA_GENERATOR
+    #pragma ailuropoda timeseries
+#endif
+    uint64_t counters[4];
+#ifdef AILUROPODA_GENERATOR
+    #pragma ailuropoda timeseries
+#endif
+    int16_t offsets[6];
+#ifdef AILUROPODA_GENERATOR
+    #pragma ailuropoda timeseries
+#endif
+    double values[8];
+#ifdef AILUROPODA_GENERATOR
+    #pragma ailuropoda timeseries
+#endif
+    float levels[5];
+};
+
+// Directory entries repeat their strings, which --stringref sends once. The flags travel as a
+// byte string, which takes a stringref index of its own.
+struct Contact {
+    char name[16];
+    char city[16];
+    bool flags[40];
+};
+
+struct ContactList {
+    struct Contact contacts[32];
+    char owner[16];
+};
+
+enum Shape {
+    SHAPE_NONE,
+    SHAPE_CIRCLE,
+    SHAPE_RECT,
+    SHAPE_LABEL
+};
+
+// Sparse values: decoding checks them against a bitset
+enum Priority {
+    PRIORITY_LOW = 1,
+    PRIORITY_HIGH = 40,
+    PRIORITY_URGENT = 1000
+};
+
+struct Rect {
+    int32_t width;
+    int32_t height;
+};
+
+// A tagged union: `shape` selects the member of `body` that is sent
+struct Figure {
+    uint32_t id;
+    enum Shape shape;
+    enum Priority priority;
+#ifdef AILUROPODA_GENERATOR
+    #pragma ailuropoda discriminant(shape)
+#endif
+    union {
+#ifdef AILUROPODA_GENERATOR
+        #pragma ailuropoda case(SHAPE_CIRCLE)
+#endif
+        double radius;
+#ifdef AILUROPODA_GENERATOR
+        #pragma ailuropoda case(SHAPE_RECT)
+#endif
+        struct Rect rect;
+#ifdef AILUROPODA_GENERATOR
+        #pragma ailuropoda case(SHAPE_LABEL)
+#endif
+        char label[12];
+    } body;
+};
+
+// Variable-length arrays, each with the member that counts its elements
+struct Batch {
+#ifdef AILUROPODA_GENERATOR
+    #pragma ailuropoda count(rect_count)
+#endif
+    struct Rect* rects;
+    uint8_t rect_count;
+#ifdef AILUROPODA_GENERATOR
+    #pragma ailuropoda count(mask_count)
+#endif
+    bool* mask;
+    uint16_t mask_count;
+#ifdef AILUROPODA_GENERATOR
+    #pragma ailuropoda count(weight_count)
+#endif
+    double* weights;
+    uint32_t weight_count;
+};
+
+// A flexible array member: the storage behind the struct holds the elements
+struct Packet {
+    uint32_t sequence;
+    uint16_t length;
+#ifdef AILUROPODA_GENERATOR
+    #pragma ailuropoda count(length)
+#endif
+    uint8_t payload[];
+};
+
+// Multi-dimensional arrays, sent as RFC 8746 row-major arrays
+struct Grid {
+    uint32_t id;
+    float matrix[3][4];
+    int16_t cube[2][2][2];
+    uint8_t image[2][5];
+};
+
 #endif // SIMPLE_DATA_H
@@ -184,6 +184,13 @@ def setup_test_environment(tmp_path, tinycbor_install_path, cpp_info):
                 str(HEADER_FILE),
                 "--output-dir",
                 str(output_dir),
+                # Generate the functions the harness round-trips, along with the defaults
+                "--delta",
+                "--streaming",
+                "--trusted",
+                "--stringref",
+                "--fixed-layout",
+                "--enum-names",
                 "--cpp-path",
                 cpp_path,  # Pass cpp_path from fixture
                 "--cpp-args",
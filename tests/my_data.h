@@ -29,7 +29,11 @@ struct Person {
     double balance;
     struct Address address; // Nested struct defined above
     char notes[256]; // Changed from const char* to char array for simpler codegen/decoding
-    int* favorite_number; // Pointer to int - requires manual memory management for decoding
+#ifdef AILUROPODA_GENERATOR // Only the generator sees the annotation, so -Wall doesn't warn about it
+    #pragma ailuropoda count(favorite_number_count)
+#endif
+    int* favorite_number; // Variable-length array of favorite_number_count ints, allocated by the decoder
+    uint32_t favorite_number_count;
     // void (*callback_func)(); // Function pointer - will be skipped
 };
 
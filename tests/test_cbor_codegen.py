@@ -16,9 +16,19 @@ from ailuropoda.cbor_codegen import (
     expand_in_place,
     get_type_info,
     generate_cbor_code,
+    parse_annotation,
+    process_struct,
+    build_argument_parser,
+    serve_request,
+    file_watcher,
+    InotifyWatcher,
 )
+import json
 import os
+import socket
+import subprocess
 import tempfile
+import time
 
 
 @pytest.fixture(scope="module")
@@ -136,6 +146,26 @@ def test_expand_in_place_typedef_struct(cpp_info):
     assert member_type_after.type.name == "Inner"
 
 
+def test_expand_in_place_typedef_chain(cpp_info):
+    c_code = """
+    typedef short sample_t;
+    typedef sample_t reading_t;
+    struct P { int x; };
+    typedef struct P point_t;
+    typedef point_t location_t;
+    struct Data { reading_t level; location_t where; };
+    """
+    ast = parse_c_string(c_code, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"])
+    struct_node = find_struct("Data", ast)
+
+    # Each typedef chain resolves to its end, not just one level down
+    level = expand_in_place(struct_node.decls[0].type, ast)
+    assert level.type.names == ["short"]
+    where = expand_in_place(struct_node.decls[1].type, ast)
+    assert isinstance(where.type, c_ast.Struct)
+    assert where.type.name == "P"
+
+
 def test_expand_in_place_nested_typedef_array(cpp_info):
     c_code = """
     typedef char MyChar;
@@ -330,6 +360,27 @@ def test_get_type_info_struct_array(cpp_info):
     assert is_ptr is False
 
 
+def test_get_type_info_bitfield(cpp_info):
+    c_code = """
+    struct Flags {
+        unsigned ready : 1;
+        int offset : 5;
+        unsigned plain;
+    };
+    """
+    ast = parse_c_string(c_code, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"])
+    struct_node = find_struct("Flags", ast)
+    assert struct_node is not None
+
+    ready, offset, plain = struct_node.decls
+    assert get_type_info(ready.type, ast, ready.bitsize) == ("unsigned int", "bitfield", None, False)
+    assert get_type_info(offset.type, ast, offset.bitsize) == ("int", "bitfield", None, False)
+    assert get_type_info(plain.type, ast, plain.bitsize) == ("unsigned int", "primitive", None, False)
+
+    members = process_struct(struct_node, ast)["members"]
+    assert [member["bit_width"] for member in members] == [1, 5, None]
+
+
 def test_generate_cbor_code_for_struct_simple(tmp_path, cpp_info):
     c_code = """
     #include <stdint.h>
@@ -373,3 +424,972 @@ def test_generate_cbor_code_for_struct_simple(tmp_path, cpp_info):
     assert "add_library(cbor_generated STATIC cbor_generated.c)" in cmake_content
     # Updated assertion to match the new CMake template logic
     assert "target_link_libraries(cbor_generated PRIVATE ${TINYCBOR_LIBRARY})" in cmake_content
+
+
+def test_parse_annotation():
+    assert parse_annotation("ailuropoda quantize(scale=0.01, offset=-40)") == (
+        "quantize",
+        {"scale": 0.01, "offset": -40},
+    )
+    assert parse_annotation("ailuropoda quantize(0.5)") == ("quantize", {0: 0.5})
+    assert parse_annotation("once") is None
+    with pytest.raises(ValueError):
+        parse_annotation("ailuropoda (scale=1)")
+    with pytest.raises(ValueError, match="finite"):
+        parse_annotation("ailuropoda quantize(scale=inf)")
+    with pytest.raises(ValueError, match="finite"):
+        parse_annotation("ailuropoda quantize(0.5, offset=nan)")
+
+
+def test_process_struct_quantize_annotation(cpp_info):
+    c_code = """
+    struct Sensor {
+        int id;
+        #pragma ailuropoda quantize(scale=0.01, offset=-40)
+        float temperature;
+        #ifdef AILUROPODA_GENERATOR
+        #pragma ailuropoda quantize(0.5)
+        #endif
+        double readings[4];
+        float raw;
+    };
+    """
+    ast = parse_c_string(c_code, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"])
+    struct_info = process_struct(find_struct("Sensor", ast), ast)
+
+    members = {member["name"]: member for member in struct_info["members"]}
+    assert list(members) == ["id", "temperature", "readings", "raw"]  # Pragmas are not members
+    assert members["temperature"]["quantize"] == {"scale": "0.01", "offset": "-40.0", "inv_scale": "100.0"}
+    assert members["readings"]["quantize"]["scale"] == "0.5"  # Annotations hidden from the compiler count
+    assert members["readings"]["type_category"] == "array"
+    assert members["raw"]["quantize"] is None  # Annotations apply to the next member only
+    assert members["id"]["quantize"] is None
+
+
+def test_generate_cbor_code_quantized_member(tmp_path, cpp_info):
+    c_code = """
+    struct Sensor {
+        #pragma ailuropoda quantize(scale=0.01, offset=-40)
+        float temperature;
+        float raw;
+    };
+    """
+    header_file = tmp_path / "sensor.h"
+    header_file.write_text(c_code)
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+
+    generate_cbor_code(header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"])
+
+    generated_c_content = (output_dir / "cbor_generated.c").read_text()
+    assert "quantize_value(data->temperature, -40.0, 100.0)" in generated_c_content
+    assert "decode_quantized(&temp_quantized, -40.0, 0.01, &map_it)" in generated_c_content
+    assert "cbor_encode_float(&map_encoder, data->raw)" in generated_c_content
+
+
+def test_generate_cbor_code_bool_bitmap(tmp_path, cpp_info):
+    c_code = """
+    #include <stdbool.h>
+    struct Status {
+        bool channels[20];
+        unsigned mode : 3;
+    };
+    """
+    header_file = tmp_path / "status.h"
+    header_file.write_text(c_code)
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+
+    generate_cbor_code(header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"])
+
+    generated_c_content = (output_dir / "cbor_generated.c").read_text()
+    assert "uint8_t bitmap[3];" in generated_c_content
+    assert "encode_bool_bitmap(data->channels, 20, bitmap, &map_encoder)" in generated_c_content
+    assert "decode_bool_bitmap(data->channels, 20, bitmap, &map_it)" in generated_c_content
+    assert "temp_bitfield > UINT64_C(7)" in generated_c_content
+    assert "data->mode = temp_bitfield;" in generated_c_content
+
+
+def test_generate_cbor_code_timeseries_member(tmp_path, cpp_info):
+    c_code = """
+    #include <stdint.h>
+    struct Series {
+        #pragma ailuropoda timeseries
+        int32_t ts[256];
+        #pragma ailuropoda timeseries
+        double v[256];
+        #pragma ailuropoda timeseries
+        char label[8];
+        #pragma ailuropoda timeseries
+        int64_t history[512];
+    };
+    """
+    header_file = tmp_path / "series.h"
+    header_file.write_text(c_code)
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+
+    ast = parse_c_string(c_code, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"])
+    struct_info = process_struct(find_struct("Series", ast), ast)
+    # 512 int64_t can take 5130 bytes compressed, more than the encode buffer may hold
+    assert [member["timeseries"] for member in struct_info["members"]] == ["dod", "xor", None, None]
+
+    generate_cbor_code(header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"])
+
+    generated_c_content = (output_dir / "cbor_generated.c").read_text()
+    generated_h_content = (output_dir / "cbor_generated.h").read_text()
+    assert "#define CBOR_TAG_TIMESERIES_DOD" in generated_h_content
+    assert "uint8_t ts_buffer[TS_MAX_PAYLOAD_DOD(256, sizeof(data->ts[0]))];" in generated_c_content
+    assert "ts_encode_dod_int(data->ts, 256, ts_buffer)" in generated_c_content
+    # The decoder reads the payload where it is in the message
+    assert "err = cbor_value_get_byte_string_chunk(it, &chunk, &chunk_len, it);" in generated_c_content
+    assert "ts_decode_xor_double(data->v, 256, ts_payload, ts_len)" in generated_c_content
+    assert "ts_encode_xor_float" not in generated_c_content
+
+
+def test_generate_cbor_code_stringref(tmp_path, cpp_info):
+    c_code = """
+    struct Address {
+        char city[24];
+    };
+    struct Person {
+        char name[32];
+        struct Address address;
+    };
+    """
+    header_file = tmp_path / "people.h"
+    header_file.write_text(c_code)
+
+    plain_dir = tmp_path / "plain"
+    plain_dir.mkdir()
+    generate_cbor_code(header_file, plain_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"])
+    assert "stringref" not in (plain_dir / "cbor_generated.c").read_text()
+    assert "encode_Address_ctx(&data->address, &map_encoder, ctx)" in (plain_dir / "cbor_generated.c").read_text()
+
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+    generate_cbor_code(
+        header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"], stringref=True
+    )
+
+    generated_c_content = (output_dir / "cbor_generated.c").read_text()
+    generated_h_content = (output_dir / "cbor_generated.h").read_text()
+    assert "bool encode_Person_stringref(const struct Person* data, CborEncoder* encoder);" in generated_h_content
+    assert "bool decode_Person_stringref(struct Person* data, CborValue* it);" in generated_h_content
+    assert 'encode_text_ref("city", 4, &map_encoder, ctx)' in generated_c_content
+    assert "stringref_scan(&scan_it, &strings)" in generated_c_content
+
+
+def test_generate_cbor_code_delta(tmp_path, cpp_info):
+    c_code = """
+    struct Point {
+        int x;
+        int y;
+    };
+    struct Track {
+        unsigned id;
+        int samples[16];
+        struct Point points[4];
+    };
+    """
+    header_file = tmp_path / "track.h"
+    header_file.write_text(c_code)
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+
+    # Delta encoding is opt-in
+    generate_cbor_code(header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"])
+    assert "encode_Track_delta" not in (output_dir / "cbor_generated.h").read_text()
+
+    generate_cbor_code(
+        header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"], delta=True
+    )
+
+    generated_c_content = (output_dir / "cbor_generated.c").read_text()
+    generated_h_content = (output_dir / "cbor_generated.h").read_text()
+    assert (
+        "bool encode_Track_delta(const struct Track* prev, const struct Track* cur, CborEncoder* encoder);"
+        in generated_h_content
+    )
+    assert "bool apply_Track_delta(struct Track* state, CborValue* it);" in generated_h_content
+    assert "if (memcmp(&prev->id, &cur->id, sizeof(cur->id)) != 0) {" in generated_c_content
+    assert "encode_Point_delta_ctx(&prev->points[i], &cur->points[i], &array_encoder, ctx)" in generated_c_content
+    assert "apply_Point_delta_ctx(&data->points[i], &array_it, ctx)" in generated_c_content
+
+
+def test_generate_cbor_code_delta_counted_array(tmp_path, cpp_info):
+    c_code = """
+    #include <stdint.h>
+    struct Trace {
+        #pragma ailuropoda count(sample_count)
+        int16_t* samples;
+        uint32_t sample_count;
+    };
+    """
+    header_file = tmp_path / "trace.h"
+    header_file.write_text(c_code)
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+
+    generate_cbor_code(
+        header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"], delta=True
+    )
+
+    generated_c_content = (output_dir / "cbor_generated.c").read_text()
+    generated_h_content = (output_dir / "cbor_generated.h").read_text()
+    assert "void (*release)(void* state, void* ptr);" in generated_h_content
+    # A delta decodes into the storage it already has, where a full decode starts afresh
+    assert generated_c_content.count("err = decode_Trace_samples(data, &map_it, ctx, true);") == 1
+    assert generated_c_content.count("err = decode_Trace_samples(data, &map_it, ctx, false);") == 1
+    assert "if (in_place && data->samples && count <= (size_t)data->sample_count) {" in generated_c_content
+    assert "if (in_place && data->samples) decode_release(data->samples, ctx);" in generated_c_content
+
+
+def test_generate_cbor_code_fixed_layout(tmp_path, cpp_info):
+    c_code = """
+    #include <stdbool.h>
+    struct Sample {
+        unsigned short id;
+        int value;
+        double reading;
+        bool flags[10];
+        char name[8];
+    };
+    struct Named {
+        char* name;
+    };
+    """
+    header_file = tmp_path / "sample.h"
+    header_file.write_text(c_code)
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+
+    generate_cbor_code(
+        header_file,
+        output_dir,
+        cpp_path=cpp_info["cpp_path"],
+        cpp_args=cpp_info["cpp_args"],
+        fixed_layout_mode=True,
+    )
+
+    generated_c_content = (output_dir / "cbor_generated.c").read_text()
+    generated_h_content = (output_dir / "cbor_generated.h").read_text()
+    # Map head, then "id" with a 2-byte head, "value" with a 4-byte head, "reading" as a double,
+    # "flags" as a 2-byte bitmap and "name" as 7 padded bytes.
+    assert "#define SAMPLE_FIXED_SIZE 57 " in generated_h_content
+    assert "size_t encode_Sample_fixed(const struct Sample* data, uint8_t* buf, size_t buf_size);" in generated_h_content
+    assert "void patch_Sample_value(uint8_t* buf, int value);" in generated_h_content
+    assert "bool patch_Sample_flags(uint8_t* buf, size_t index, bool value);" in generated_h_content
+    assert "void patch_Sample_name(uint8_t* buf, const char* value);" in generated_h_content
+    assert "0xa5, 0x62, 0x69, 0x64, 0x19, 0x00, 0x00," in generated_c_content
+    assert "fixed_put_int(buf + 13, (int64_t)data->value, 4);" in generated_c_content
+    assert "fixed_put_text(buf + 50, data->name, 7);" in generated_c_content
+    # A char* member has no fixed size, so Named keeps only the regular encoder
+    assert "encode_Named_fixed" not in generated_h_content
+    assert "bool encode_Named(const struct Named* data, CborEncoder* encoder);" in generated_h_content
+
+
+def test_generate_cbor_code_member_defaults(tmp_path, cpp_info):
+    c_code = """
+    struct Config {
+        #pragma ailuropoda default(8080)
+        unsigned short port;
+        #pragma ailuropoda default("localhost")
+        char host[32];
+        #pragma ailuropoda default(1.5)
+        int retries;
+        int values[4];
+    };
+    """
+    header_file = tmp_path / "config.h"
+    header_file.write_text(c_code)
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+
+    generate_cbor_code(header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"])
+
+    generated_c_content = (output_dir / "cbor_generated.c").read_text()
+    generated_h_content = (output_dir / "cbor_generated.h").read_text()
+    assert "#define CONFIG_MEMBER_HOST (UINT64_C(1) << 1)" in generated_h_content
+    assert "#define CONFIG_ALL_MEMBERS (~UINT64_C(0) >> 60)" in generated_h_content
+    assert (
+        "CborError decode_Config_ctx(struct Config* data, CborValue* it, const cbor_decode_ctx* ctx, uint64_t* seen);"
+        in generated_h_content
+    )
+    assert "void set_Config_defaults(struct Config* data, uint64_t seen);" in generated_h_content
+    assert "seen_members |= CONFIG_MEMBER_PORT;" in generated_c_content
+    assert "data->port = 8080u;" in generated_c_content
+    assert 'memcpy(data->host, "localhost", sizeof("localhost"));' in generated_c_content
+    assert "data->retries = 0;" in generated_c_content  # A float default for an int is ignored
+    assert "memset(data->values, 0, sizeof(data->values));" in generated_c_content
+    assert "memset(buffer, 0, buffer_size);" not in generated_c_content
+
+
+def test_generate_cbor_code_error_reporting(tmp_path, cpp_info):
+    c_code = """
+    struct Leaf {
+        int value;
+    };
+    struct Tree {
+        char name[8];
+        struct Leaf leaves[4];
+    };
+    """
+    header_file = tmp_path / "tree.h"
+    header_file.write_text(c_code)
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+
+    generate_cbor_code(header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"])
+
+    generated_c_content = (output_dir / "cbor_generated.c").read_text()
+    generated_h_content = (output_dir / "cbor_generated.h").read_text()
+    assert "cbor_decode_diag* diag;" in generated_h_content
+    assert (
+        "CborError encode_Tree_ctx(const struct Tree* data, CborEncoder* encoder, cbor_encode_ctx* ctx);"
+        in generated_h_content
+    )
+    assert "bool decode_Tree(struct Tree* data, CborValue* it);" in generated_h_content  # Wrappers stay bool
+    assert (
+        'if (err != CborNoError) return decode_error(ctx, err, "Tree", "name", SIZE_MAX, &map_it);'
+        in generated_c_content
+    )
+    assert (
+        "err = decode_int_in_range(&temp_int, INT_MIN, INT_MAX, &map_it);\n"
+        '            if (err != CborNoError) return decode_error(ctx, err, "Leaf", "value", SIZE_MAX, &map_it);'
+        in generated_c_content
+    )
+    assert 'return decode_nested_error(ctx, err, "leaves", i);' in generated_c_content
+    assert "DEBUG" not in generated_c_content
+
+
+def test_generate_cbor_code_trusted_decode(tmp_path, cpp_info):
+    c_code = """
+    struct Reading {
+        unsigned int mode : 3;
+        char label[8];
+        double values[4];
+    };
+    """
+    header_file = tmp_path / "reading.h"
+    header_file.write_text(c_code)
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+
+    # Trusted decoding is opt-in
+    generate_cbor_code(header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"])
+    assert "validate_Reading" not in (output_dir / "cbor_generated.h").read_text()
+    assert "decode_Reading_trusted" not in (output_dir / "cbor_generated.c").read_text()
+
+    generate_cbor_code(
+        header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"], trusted=True
+    )
+
+    generated_c_content = (output_dir / "cbor_generated.c").read_text()
+    generated_h_content = (output_dir / "cbor_generated.h").read_text()
+    assert "CborError validate_Reading(const CborValue* it, cbor_decode_diag* diag);" in generated_h_content
+    assert "bool decode_Reading_trusted(struct Reading* data, CborValue* it);" in generated_h_content
+    assert (
+        "bool decode_Reading_trusted_ctx(struct Reading* data, CborValue* it, const cbor_decode_ctx* ctx);"
+        in generated_h_content
+    )
+    # The validator checks what the trusted decoder assumes: ranges and string capacities
+    assert (
+        'if (bitfield_value > UINT64_C(7)) return decode_error(ctx, CborErrorDataTooLarge, "Reading", "mode", SIZE_MAX, &map_it);'
+        in generated_c_content
+    )
+    assert (
+        'if (text_len >= 8) return decode_error(ctx, CborErrorDataTooLarge, "Reading", "label", SIZE_MAX, &map_it);'
+        in generated_c_content
+    )
+    # The trusted decoder reads values without checking their type first
+    trusted_body = generated_c_content.split("bool decode_Reading_trusted_ctx(")[1].split("\n}\n")[0]
+    assert "cbor_value_get_type" not in trusted_body
+    assert "cbor_value_copy_text_string(&map_it, data->label, &text_len, &map_it);" in trusted_body
+    # Member bodies are indented like those of the checked decoder
+    assert (
+        "            uint64_t value;\n"
+        "            cbor_value_get_uint64(&map_it, &value);\n"
+        "            data->mode = (unsigned int)value;\n"
+    ) in trusted_body
+
+
+def test_generate_cbor_code_integer_widths(tmp_path, cpp_info):
+    c_code = """
+    #include <stdint.h>
+    struct Widths {
+        int8_t small;
+        int64_t big;
+        uint16_t port;
+        short history[4];
+    };
+    """
+    header_file = tmp_path / "widths.h"
+    header_file.write_text(c_code)
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+
+    generate_cbor_code(header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"])
+
+    generated_c_content = (output_dir / "cbor_generated.c").read_text()
+    # Every integer is decoded through a 64-bit temporary and checked against its own type's range
+    assert "cbor_value_get_int(" not in generated_c_content
+    assert "err = decode_int_in_range(&temp_int, SCHAR_MIN, SCHAR_MAX, &map_it);" in generated_c_content
+    assert "err = decode_int_in_range(&temp_int, LLONG_MIN, LLONG_MAX, &map_it);" in generated_c_content
+    assert "err = decode_uint_in_range(&temp_uint, USHRT_MAX, &map_it);" in generated_c_content
+    assert "err = decode_int_in_range(&temp_int_array, SHRT_MIN, SHRT_MAX, &array_it);" in generated_c_content
+    assert "data->small = (signed char)temp_int;" in generated_c_content
+
+
+def test_generate_cbor_code_streaming(tmp_path, cpp_info):
+    c_code = """
+    struct Sample {
+        int id;
+        int history[8];
+    };
+    """
+    header_file = tmp_path / "sample.h"
+    header_file.write_text(c_code)
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+
+    # Streaming is opt-in
+    generate_cbor_code(header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"])
+    assert "_stream_" not in (output_dir / "cbor_generated.h").read_text()
+
+    generate_cbor_code(
+        header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"], streaming=True
+    )
+
+    generated_c_content = (output_dir / "cbor_generated.c").read_text()
+    generated_h_content = (output_dir / "cbor_generated.h").read_text()
+    assert "size_t encode_Sample_stream_begin(uint8_t* buf, size_t buf_size);" in generated_h_content
+    assert (
+        "size_t encode_Sample_stream_append(const struct Sample* data, uint8_t* buf, size_t buf_size);"
+        in generated_h_content
+    )
+    assert "CborError decode_Sample_stream_begin(CborValue* it, CborValue* elements);" in generated_h_content
+    assert "buf[0] = 0x9f; // Array head with indefinite length" in generated_c_content
+    # Array members are counted while decoding instead of asking for a (definite) length
+    assert "cbor_value_get_array_length" not in generated_c_content
+    assert (
+        "for (size_t i = 0; i < 8 && !cbor_value_at_end(&array_it); ++i, ++array_len) {" in generated_c_content
+    )
+
+
+def test_generate_cbor_code_counted_arrays(tmp_path, cpp_info):
+    c_code = """
+    #include <stdint.h>
+    struct Point {
+        int x;
+    };
+    struct Trace {
+        #pragma ailuropoda count(sample_count)
+        int16_t* samples;
+        uint32_t sample_count;
+        #pragma ailuropoda count(point_count)
+        struct Point* points;
+        uint8_t point_count;
+        int* unannotated;
+    };
+    """
+    header_file = tmp_path / "trace.h"
+    header_file.write_text(c_code)
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+
+    generate_cbor_code(header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"])
+
+    generated_c_content = (output_dir / "cbor_generated.c").read_text()
+    generated_h_content = (output_dir / "cbor_generated.h").read_text()
+    assert "const cbor_allocator* allocator;" in generated_h_content
+    assert "void* cbor_arena_alloc(void* arena, size_t size);" in generated_h_content
+    # Counts are implied by the array length, and unannotated pointers are skipped
+    assert "TRACE_MEMBER_SAMPLE_COUNT" not in generated_h_content
+    assert "TRACE_MEMBER_UNANNOTATED" not in generated_h_content
+    # Primitive elements are bulk-copied as a typed array; struct elements go through a CBOR array
+    assert (
+        "err = encode_typed_array(data->samples, (size_t)data->sample_count, sizeof(short), "
+        "typed_array_tag(sizeof(short), false, true), &map_encoder, ctx);" in generated_c_content
+    )
+    assert (
+        "static CborError decode_Trace_points(struct Trace* data, CborValue* map_it, const cbor_decode_ctx* ctx, "
+        "bool in_place) {"
+        in generated_c_content
+    )
+    assert "err = decode_alloc(&storage, 0, count, UCHAR_MAX, sizeof(data->points[0]), ctx);" in generated_c_content
+    assert "data->point_count = (unsigned char)count;" in generated_c_content
+
+
+def test_count_annotation_requires_integer_member(tmp_path, cpp_info):
+    c_code = """
+    struct Broken {
+        #pragma ailuropoda count(missing)
+        float* values;
+    };
+    """
+    header_file = tmp_path / "broken.h"
+    header_file.write_text(c_code)
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+
+    with pytest.raises(ValueError, match="'missing' is not an integer member"):
+        generate_cbor_code(header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"])
+
+
+def test_generate_cbor_code_flexible_array_member(tmp_path, cpp_info):
+    c_code = """
+    #include <stdint.h>
+    struct Ring {
+        uint32_t seq;
+        uint16_t length;
+        #pragma ailuropoda count(length)
+        uint8_t payload[];
+    };
+    """
+    header_file = tmp_path / "ring.h"
+    header_file.write_text(c_code)
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+
+    generate_cbor_code(
+        header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"], delta=True
+    )
+
+    generated_c_content = (output_dir / "cbor_generated.c").read_text()
+    generated_h_content = (output_dir / "cbor_generated.h").read_text()
+    assert (
+        "CborError decode_Ring_alloc(struct Ring** out, CborValue* it, const cbor_decode_ctx* ctx);"
+        in generated_h_content
+    )
+    # One allocation for the struct and its elements, whose count is the capacity decode_Ring_ctx fills
+    assert (
+        "err = decode_alloc(&storage, sizeof(struct Ring), count, USHRT_MAX, element_size, ctx);"
+        in generated_c_content
+    )
+    assert "sized_ctx.flexible_capacity = count;" in generated_c_content
+    assert "if (count > ctx->flexible_capacity) return decode_error(" in generated_c_content
+    # Without a context, the count on entry is the capacity
+    assert "ctx = { NULL, NULL, NULL, data->length > 0 ? (size_t)data->length : 0 };" in generated_c_content
+    assert "ctx = { NULL, NULL, NULL, state->length > 0 ? (size_t)state->length : 0 };" in generated_c_content
+    assert "data->payload = " not in generated_c_content  # The elements are stored in place
+
+
+def test_generate_cbor_code_multidim_array(tmp_path, cpp_info):
+    c_code = """
+    #include <stdint.h>
+    struct Frame {
+        float matrix[64][64];
+        int16_t cube[2][3][4];
+        uint8_t grid[4];
+    };
+    """
+    header_file = tmp_path / "frame.h"
+    header_file.write_text(c_code)
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+
+    generate_cbor_code(header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"])
+
+    generated_c_content = (output_dir / "cbor_generated.c").read_text()
+    # Dimensions are sent once, followed by the elements as one typed array copied in bulk
+    assert "#define CBOR_TAG_MULTI_DIM_ARRAY 40" in generated_c_content
+    assert "static const size_t dims[2] = { 64, 64 };" in generated_c_content
+    assert "static const size_t dims[3] = { 2, 3, 4 };" in generated_c_content
+    assert (
+        "err = encode_multidim_array(data->matrix, dims, 2, sizeof(float), typed_array_tag(sizeof(float), true, false), &map_encoder, ctx);"
+        in generated_c_content
+    )
+    assert (
+        "err = decode_multidim_array(data->cube, dims, 3, sizeof(short), typed_array_tag(sizeof(short), false, true), &map_it);"
+        in generated_c_content
+    )
+    assert "data->matrix[i]" not in generated_c_content
+    # One-dimensional arrays keep their element-wise encoding
+    assert "for (size_t i = 0; i < 4; ++i) {" in generated_c_content
+
+
+def test_generate_cbor_code_union(tmp_path, cpp_info):
+    c_code = """
+    #include <stdint.h>
+    struct Point { int32_t x; int32_t y; };
+    struct Message {
+        uint8_t kind;
+        #pragma ailuropoda discriminant(kind)
+        union {
+            #pragma ailuropoda case(1)
+            int32_t count;
+            #pragma ailuropoda case(4)
+            struct Point where;
+            float ratio;
+        } body;
+    };
+    """
+    header_file = tmp_path / "message.h"
+    header_file.write_text(c_code)
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+
+    generate_cbor_code(header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"])
+
+    generated_c_content = (output_dir / "cbor_generated.c").read_text()
+    generated_h_content = (output_dir / "cbor_generated.h").read_text()
+    # The discriminant travels with the active arm, as [kind, value]
+    assert "MESSAGE_MEMBER_KIND" not in generated_h_content
+    assert "err = encode_Message_body(data, &map_encoder, ctx);" in generated_c_content
+    assert "err = cbor_encode_uint(&map_encoder, data->kind);" in generated_c_content
+    # The decoder switches straight to the arm; unannotated arms take their position
+    assert "switch (data->kind) {" in generated_c_content
+    assert "case 1:" in generated_c_content
+    assert "case 2:" in generated_c_content
+    assert "err = decode_Point_ctx(&data->body.where, &map_it, ctx, NULL);" in generated_c_content
+    assert '"Message", "body.count"' in generated_c_content
+
+
+def test_union_arms_need_distinct_cases(tmp_path, cpp_info):
+    c_code = """
+    struct Message {
+        int kind;
+        #pragma ailuropoda discriminant(kind)
+        union {
+            #pragma ailuropoda case(1)
+            int count;
+            float ratio;
+        } body;
+    };
+    """
+    header_file = tmp_path / "message.h"
+    header_file.write_text(c_code)
+
+    with pytest.raises(ValueError, match="two arms for case 1"):
+        generate_cbor_code(header_file, tmp_path, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"])
+
+
+def test_generate_cbor_code_enums(tmp_path, cpp_info):
+    c_code = """
+    enum Color { RED, GREEN, BLUE };
+    typedef enum { MODE_OFF = -1, MODE_ON = 1, MODE_AUTO = 1 << 4 } Mode;
+    struct Device {
+        enum Color color;
+        #pragma ailuropoda default(MODE_ON)
+        Mode mode;
+    };
+    """
+    header_file = tmp_path / "device.h"
+    header_file.write_text(c_code)
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+
+    generate_cbor_code(
+        header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"], enum_names=True
+    )
+
+    generated_c_content = (output_dir / "cbor_generated.c").read_text()
+    generated_h_content = (output_dir / "cbor_generated.h").read_text()
+    assert "err = cbor_encode_int(&map_encoder, data->color);" in generated_c_content
+    # A dense enum is a range check; a sparse one also looks its values up in a bitset
+    assert "err = decode_int_in_range(value, INT64_C(0), INT64_C(2), it);" in generated_c_content
+    assert "static const uint8_t members[3] = { 5, 0, 2 };" in generated_c_content
+    assert "err = decode_enum_Mode(&temp_int, &map_it);" in generated_c_content
+    assert "data->mode = (Mode)temp_int;" in generated_c_content
+    assert "data->mode = MODE_ON;" in generated_c_content
+    assert "const char* Color_name(enum Color value);" in generated_h_content
+    assert "bool Mode_from_name(const char* name, Mode* value);" in generated_h_content
+
+
+def test_generate_cbor_code_typedef_anonymous_struct_member(tmp_path, cpp_info):
+    # tests/my_data.h has a `Point location;` member whose type is a typedef of an anonymous struct,
+    # so the member's type has no name of its own
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+
+    generate_cbor_code(
+        PROJECT_ROOT / "tests" / "my_data.h",
+        output_dir,
+        cpp_path=cpp_info["cpp_path"],
+        cpp_args=cpp_info["cpp_args"],
+    )
+
+    generated_h_content = (output_dir / "cbor_generated.h").read_text()
+    assert "#define PERSON_MEMBER_LOCATION" in generated_h_content
+    assert "bool encode_Person(const struct Person* data, CborEncoder* encoder);" in generated_h_content
+
+def test_generate_cbor_code_key_table(tmp_path, cpp_info):
+    c_code = """
+    struct Reading {
+        int id;
+        float a_member_name_longer_than_twenty_four_chars;
+    };
+    """
+    header_file = tmp_path / "reading.h"
+    header_file.write_text(c_code)
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+
+    generate_cbor_code(header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"])
+
+    generated_c_content = (output_dir / "cbor_generated.c").read_text()
+    # Each key is its text string head followed by the name; a 43-byte name needs a 1-byte length
+    assert '"\\x62" "id"' in generated_c_content
+    assert '"\\x78\\x2b" "a_member_name_longer_than_twenty_four_chars";' in generated_c_content
+    # By default a key is a text string of constant length; copying the table's bytes into the
+    # encoder's buffer relies on TinyCBOR internals, so it is opt-in
+    assert 'err = CBOR_GENERATED_ENCODE_KEY(&map_encoder, Reading_keys, 0, 3, "id");' in generated_c_content
+    assert "cbor_encode_text_string(encoder, name, sizeof(name) - 1)" in generated_c_content
+    assert "#ifdef CBOR_RAW_KEYS\n// Map keys of struct Reading" in generated_c_content
+
+
+def test_generate_cbor_code_header_only(tmp_path, cpp_info):
+    c_code = """
+    struct Point {
+        int x;
+        int y;
+    };
+    """
+    header_file = tmp_path / "point.h"
+    header_file.write_text(c_code)
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+
+    generate_cbor_code(
+        header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"], header_only=True
+    )
+
+    assert not (output_dir / "cbor_generated.c").exists()
+    generated_h_content = (output_dir / "cbor_generated.h").read_text()
+    # Declarations and definitions are both static inline, so every includer can inline them
+    assert "static inline bool encode_Point(const struct Point* data, CborEncoder* encoder);" in generated_h_content
+    assert "static inline bool encode_Point(const struct Point* data, CborEncoder* encoder) {" in generated_h_content
+    assert '#include "cbor_generated.h"' not in generated_h_content
+    assert generated_h_content.index("#define CBOR_GENERATED_HEADER_ONLY") < generated_h_content.index(
+        "#endif // CBOR_GENERATED_H"
+    )
+    cmake_content = (output_dir / "CMakeLists.txt").read_text()
+    assert "add_library(cbor_generated INTERFACE)" in cmake_content
+
+
+def test_generate_cbor_code_structs_per_file(tmp_path, cpp_info):
+    c_code = """
+    struct Point {
+        int x;
+        int y;
+    };
+    struct Label {
+        char text[16];
+    };
+    """
+    header_file = tmp_path / "shapes.h"
+    header_file.write_text(c_code)
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+
+    def generate():
+        generate_cbor_code(
+            header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"], structs_per_file=1
+        )
+
+    generate()
+    point_c_content = (output_dir / "cbor_generated_Point.c").read_text()
+    assert '#include "cbor_generated_internal.h"' in point_c_content
+    assert "bool encode_Point(" in point_c_content
+    assert "encode_Label" not in point_c_content
+    assert "static CBOR_GENERATED_MAYBE_UNUSED CborError decode_char_array(" in (output_dir / "cbor_generated_internal.h").read_text()
+    cmake_content = (output_dir / "CMakeLists.txt").read_text()
+    assert "    cbor_generated.c\n    cbor_generated_Point.c\n    cbor_generated_Label.c\n" in cmake_content
+
+    # Regenerating the same code leaves every file alone, so nothing is rebuilt
+    mtimes = {path.name: path.stat().st_mtime_ns for path in output_dir.iterdir()}
+    generate()
+    assert {path.name: path.stat().st_mtime_ns for path in output_dir.iterdir()} == mtimes
+
+
+def test_generate_cbor_code_reuses_cache(tmp_path, cpp_info, monkeypatch):
+    import ailuropoda.cbor_codegen as codegen
+
+    header_file = tmp_path / "shapes.h"
+    header_file.write_text("struct Point { int x; int y; };\nstruct Label { char text[16]; };\n")
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+
+    def generate():
+        generate_cbor_code(
+            header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"], structs_per_file=1
+        )
+
+    generate()
+    assert (output_dir / codegen.CACHE_FILE_NAME).exists()
+    expected = {path.name: path.read_text() for path in output_dir.glob("cbor_generated*")}
+
+    # Same header: neither parsed nor rendered, even into files that were deleted
+    (output_dir / "cbor_generated_Point.c").unlink()
+    rendered = []
+
+    def record_generated(path, content):
+        if path.name.startswith("cbor_generated"):
+            rendered.append(path.name)
+
+    monkeypatch.setattr(codegen, "process_struct", lambda *args: pytest.fail("header parsed again"))
+    monkeypatch.setattr(codegen, "write_if_changed", record_generated)
+    generate()
+    assert rendered == ["cbor_generated_Point.c"]
+    monkeypatch.undo()
+    generate()
+    assert {path.name: path.read_text() for path in output_dir.glob("cbor_generated*")} == expected
+
+    # An edited struct re-renders its own file (and the header), not the others
+    header_file.write_text("struct Point { int x; int y; int z; };\nstruct Label { char text[16]; };\n")
+    rendered.clear()
+    monkeypatch.setattr(codegen, "write_if_changed", record_generated)
+    generate()
+    assert sorted(rendered) == ["cbor_generated.h", "cbor_generated_Point.c"]
+
+
+def test_generate_cbor_code_preprocessed_input(tmp_path, cpp_info):
+    header_file = tmp_path / "point.h"
+    header_file.write_text("#define COORD int\nstruct Point { COORD x; COORD y; };\n")
+
+    preprocessed_file = tmp_path / "point.i"
+    subprocess.run([cpp_info["cpp_path"], "point.h", "-o", "point.i"], cwd=tmp_path, check=True)
+
+    # A .i file is parsed as is: no cpp runs, and the code includes the header it came from
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+    generate_cbor_code(preprocessed_file, output_dir, cpp_path=str(tmp_path / "no-such-cpp"), use_cache=False)
+    assert f'#include "{header_file}"' in (output_dir / "cbor_generated.h").read_text()
+    assert "bool encode_Point(" in (output_dir / "cbor_generated.c").read_text()
+
+
+def test_generate_cbor_code_multiple_headers(tmp_path, cpp_info):
+    (tmp_path / "common.h").write_text("#pragma once\nstruct Header { int id; };\n")
+    (tmp_path / "a.h").write_text('#include "common.h"\nstruct A { struct Header header; int a; };\n')
+    (tmp_path / "b.h").write_text('#include "common.h"\nstruct B { struct Header header; float b; };\n')
+    (tmp_path / "clash.h").write_text("struct A { double a; };\n")
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+
+    # Parsed in two worker processes; the struct both headers include is generated once
+    headers = [tmp_path / "a.h", tmp_path / "b.h"]
+    generate_cbor_code(headers, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=cpp_info["cpp_args"], jobs=2)
+    generated_c = (output_dir / "cbor_generated.c").read_text()
+    assert generated_c.count("bool encode_Header(") == 1
+    assert "bool encode_A(" in generated_c and "bool encode_B(" in generated_c
+    generated_h = (output_dir / "cbor_generated.h").read_text()
+    assert f'#include "{tmp_path / "a.h"}"' in generated_h and f'#include "{tmp_path / "b.h"}"' in generated_h
+
+    # Two different structs of the same name can't share one set of functions
+    with pytest.raises(ValueError, match="struct A is defined differently"):
+        generate_cbor_code(headers + [tmp_path / "clash.h"], output_dir, cpp_path=cpp_info["cpp_path"], jobs=1)
+
+
+def test_generate_cbor_code_depfile(tmp_path, cpp_info):
+    (tmp_path / "include dir").mkdir()
+    common = tmp_path / "include dir" / "common.h"
+    common.write_text("struct Header { int id; };\n")
+    header_file = tmp_path / "msg.h"
+    header_file.write_text('#include "common.h"\nstruct Msg { struct Header header; };\n')
+    output_dir = tmp_path / "generated"
+    output_dir.mkdir()
+    depfile = tmp_path / "msg.d"
+
+    generate_cbor_code(
+        header_file, output_dir, cpp_path=cpp_info["cpp_path"], cpp_args=[f"-I{common.parent}"], depfile=depfile
+    )
+    # The stamp depends on every file cpp read, with spaces escaped as make expects
+    lines = depfile.read_text().splitlines()
+    assert lines[0] == f"{output_dir / 'cbor_generated.stamp'}: \\"
+    assert lines[1] == f" {header_file} \\"
+    escaped_common = str(common).replace(" ", "\\ ")
+    assert lines[-1] == f" {escaped_common}"
+    assert (output_dir / "cbor_generated.stamp").is_file()
+
+
+def test_serve_request(tmp_path, cpp_info):
+    (tmp_path / "point.h").write_text("struct Point { int x; int y; };\n")
+    parser = build_argument_parser()
+
+    def request(args):
+        client, server = socket.socketpair()
+        with client:
+            serve_request(server, json.dumps({"cwd": str(tmp_path), "args": args}), parser, cpp_info["cpp_path"])
+            return json.loads(client.makefile().readline())
+
+    # Paths in the arguments are relative to the client's directory
+    assert request(["point.h", "--output-dir", "generated"])["ok"]
+    assert "bool encode_Point(" in (tmp_path / "generated" / "cbor_generated.c").read_text()
+    response = request(["missing.h"])
+    assert not response["ok"] and "missing.h" in response["error"]
+    # The server decides which program runs, however the option is spelled
+    for args in (["--cpp-path", "/bin/sh"], ["--cpp-path=/bin/sh"], ["--cpp-p", "/bin/sh"]):
+        response = request(["point.h", *args])
+        assert not response["ok"] and "--cpp-path can't be requested" in response["error"]
+
+
+def test_socket_server_outlasts_idle_client(tmp_path, cpp_info):
+    (tmp_path / "point.h").write_text("struct Point { int x; int y; };\n")
+    socket_path = tmp_path / "gen.sock"
+    command = [sys.executable, "-m", "ailuropoda", "--socket", str(socket_path), "--cpp-path", cpp_info["cpp_path"]]
+    env = {**os.environ, "PYTHONPATH": str(PROJECT_ROOT / "src")}
+    process = subprocess.Popen(command, env=env, stderr=subprocess.PIPE, text=True)
+    try:
+        for line in process.stderr:
+            if "Serving" in line:
+                break
+        # A client that connects and never sends its request doesn't hold up the next one
+        idle = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        idle.connect(str(socket_path))
+        with idle, socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as client:
+            client.settimeout(2)
+            client.connect(str(socket_path))
+            client.sendall(json.dumps({"cwd": str(tmp_path), "args": ["point.h"]}).encode() + b"\n")
+            assert json.loads(client.makefile().readline())["ok"]
+
+        # A second server leaves the live one's socket alone
+        second = subprocess.run(command, env=env, stderr=subprocess.PIPE, text=True, timeout=10)
+        assert second.returncode != 0 and "Another server is listening" in second.stderr
+        assert socket_path.is_socket() and process.poll() is None
+    finally:
+        process.terminate()
+        process.wait()
+
+
+@pytest.mark.skipif(not sys.platform.startswith("linux"), reason="inotify is Linux-only")
+def test_file_watcher_sees_replaced_file(tmp_path):
+    watched, other = tmp_path / "watched.h", tmp_path / "other.h"
+    watched.write_text("struct A { int a; };\n")
+    watcher = file_watcher()
+    assert isinstance(watcher, InotifyWatcher)
+    watcher.watch([watched])
+    assert watcher.changes() == set()
+
+    # Saved the way many editors do: a new file renamed over the old one
+    other.write_text("struct A { long a; };\n")
+    (tmp_path / "new.h").write_text("struct A { short a; };\n")
+    (tmp_path / "new.h").replace(watched)
+    assert watcher.changes() == {watched}
+
+
+@pytest.mark.skipif(not sys.platform.startswith("linux"), reason="inotify is Linux-only")
+def test_watch_survives_startup_error(tmp_path, cpp_info):
+    header_file = tmp_path / "msg.h"
+    header_file.write_text("struct Msg { int id }\n")  # Missing semicolon
+    generated_c = tmp_path / "generated" / "cbor_generated.c"
+    command = [sys.executable, "-m", "ailuropoda", str(header_file), "--output-dir", str(generated_c.parent)]
+    process = subprocess.Popen(
+        command + ["--watch", "--cpp-path", cpp_info["cpp_path"]],
+        env={**os.environ, "PYTHONPATH": str(PROJECT_ROOT / "src")},
+        stderr=subprocess.PIPE,
+        text=True,
+    )
+    try:
+        for line in process.stderr:
+            if "Watching" in line:
+                break
+        # The header that failed to parse is watched, so fixing it is enough for a rerun
+        header_file.write_text("struct Msg { int id; };\n")
+        deadline = time.monotonic() + 10
+        while not (generated_c.is_file() and "bool encode_Msg(" in generated_c.read_text()):
+            assert process.poll() is None and time.monotonic() < deadline
+            time.sleep(0.05)
+    finally:
+        process.terminate()
+        process.wait()